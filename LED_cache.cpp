@@ -0,0 +1,335 @@
+#include "LED_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+    const char CACHE_MAGIC[8] = { 'L', 'E', 'D', 'C', 'A', 'C', 'H', 'E' };
+
+    // Written in the machine's byte order, so that files from a machine
+    // with a different byte order are rejected.
+    const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+
+    const uint32_t EXACT_OPTIMAL = 1;
+    const uint32_t EXACT_BOUND_REACHED = 2;
+
+    // The start of every cache file.  It is followed by the unshifted
+    // table and the shifted table ('rows' Patterns each) and then the
+    // histogram ('rowBits' int32_t's).  Its size is a multiple of 8, so
+    // the tables are aligned in the mapped file.
+    struct CacheFileHeader
+    {
+        char magic[8];
+        uint32_t byteOrder;
+        uint32_t version;
+        SolutionCacheKey key;
+        uint32_t rows;
+        uint32_t rowBits;
+        int32_t peak;
+        int32_t bound;
+        int32_t annealStartPeak;
+        int32_t annealPeak;
+        uint32_t annealBestStart;
+        int32_t exactPeak;
+        int32_t exactLowerBound;
+        uint32_t exactFlags;
+        uint64_t exactNodes;
+        uint64_t checksum;          // FNV-1a of the header with this zeroed, then the rest
+    };
+    static_assert(sizeof(CacheFileHeader) % sizeof(Pattern) == 0
+        , "Cache tables must be aligned");
+    static_assert(sizeof(int) == sizeof(int32_t)
+        , "The cached histogram is used in place as int");
+
+    // 64-bit FNV-1a hash, continuing from 'hash'.
+    uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 0xCBF29CE484222325ULL)
+    {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001B3ULL;
+        }
+        return hash;
+    }
+
+    size_t payloadSize(size_t rows, size_t rowBits)
+    {
+        return 2 * rows * sizeof(Pattern) + rowBits * sizeof(int32_t);
+    }
+
+    uint64_t fileChecksum(CacheFileHeader header, const unsigned char *payload, size_t size)
+    {
+        header.checksum = 0;
+        return fnv1a(payload, size, fnv1a(&header, sizeof(header)));
+    }
+
+} // namespace
+
+SolutionCacheKey solutionCacheKey(const SolveParameters &params)
+{
+    SolutionCacheKey key;
+    memset(&key, 0, sizeof(key));
+    key.LEDs = params.LEDs;
+    key.bits = params.bits;
+    key.simple_encoding = params.simple_encoding ? 1 : 0;
+    // The parity does not affect the simple encoding.
+    key.parity = params.simple_encoding ? 0 : params.parity;
+    key.stride = (params.stride < 0) ? -1 : params.stride;
+    key.stride_optimizations = params.stride_optimizations;
+    key.anneal_starts = params.anneal_starts;
+    if (params.anneal_starts > 0) {
+        key.anneal_steps = params.anneal_steps;
+        key.seed = params.seed;
+    }
+    // Only the greedy encoding can maximize the distance.
+    key.maximize_distance = (params.maximize_distance && !params.simple_encoding) ? 1 : 0;
+    key.exact = params.exact ? 1 : 0;
+    if (params.exact) {
+        key.exact_nodes = params.exact_nodes;
+    }
+    return key;
+}
+
+std::string solutionCachePath(const std::string &directory, const SolveParameters &params)
+{
+    SolutionCacheKey key = solutionCacheKey(params);
+    std::ostringstream path;
+    path << directory << "/" << std::hex << std::setw(16) << std::setfill('0')
+        << fnv1a(&key, sizeof(key)) << ".ledcache";
+    return path.str();
+}
+
+CachedSolution::CachedSolution()
+    : m_data(0)
+    , m_size(0)
+#if defined(_WIN32)
+    , m_file(INVALID_HANDLE_VALUE)
+    , m_mapping(0)
+#endif
+{
+}
+
+CachedSolution::~CachedSolution()
+{
+    unmap();
+}
+
+void CachedSolution::unmap()
+{
+#if defined(_WIN32)
+    if (m_data) { UnmapViewOfFile(m_data); }
+    if (m_mapping) { CloseHandle(m_mapping); }
+    if (m_file != INVALID_HANDLE_VALUE) { CloseHandle(m_file); }
+    m_mapping = 0;
+    m_file = INVALID_HANDLE_VALUE;
+#else
+    if (m_data) { munmap(const_cast<unsigned char *>(m_data), m_size); }
+#endif
+    m_data = 0;
+    m_size = 0;
+}
+
+bool CachedSolution::load(const std::string &directory, const SolveParameters &params)
+{
+    unmap();
+    std::string path = solutionCachePath(directory, params);
+
+    // Map the whole file read-only.
+#if defined(_WIN32)
+    m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL
+        , OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE) { return false; }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(CacheFileHeader))) {
+        unmap();
+        return false;
+    }
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!m_mapping) {
+        unmap();
+        return false;
+    }
+    m_data = static_cast<const unsigned char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data) {
+        unmap();
+        return false;
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) { return false; }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(CacheFileHeader))) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) { return false; }
+    m_data = static_cast<const unsigned char *>(data);
+    m_size = static_cast<size_t>(info.st_size);
+#endif
+
+    // Check that this is a complete, intact entry for these parameters.
+    CacheFileHeader header;
+    memcpy(&header, m_data, sizeof(header));
+    SolutionCacheKey key = solutionCacheKey(params);
+    bool valid = memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+        && header.byteOrder == CACHE_BYTE_ORDER
+        && header.version == SOLUTION_CACHE_VERSION
+        && memcmp(&header.key, &key, sizeof(key)) == 0
+        && header.rows > 0
+        && header.rowBits > 0 && header.rowBits <= MAX_PATTERN_BITS
+        && m_size == sizeof(header) + payloadSize(header.rows, header.rowBits)
+        && header.checksum == fileChecksum(header, m_data + sizeof(header), m_size - sizeof(header));
+    if (!valid) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+PatternView CachedSolution::unshifted() const
+{
+    const CacheFileHeader *header = reinterpret_cast<const CacheFileHeader *>(m_data);
+    const Pattern *rows = reinterpret_cast<const Pattern *>(m_data + sizeof(CacheFileHeader));
+    return PatternView(rows, header->rows, header->rowBits);
+}
+
+PatternView CachedSolution::table() const
+{
+    const CacheFileHeader *header = reinterpret_cast<const CacheFileHeader *>(m_data);
+    const Pattern *rows = reinterpret_cast<const Pattern *>(m_data + sizeof(CacheFileHeader));
+    return PatternView(rows + header->rows, header->rows, header->rowBits);
+}
+
+const int *CachedSolution::histogram() const
+{
+    const CacheFileHeader *header = reinterpret_cast<const CacheFileHeader *>(m_data);
+    return reinterpret_cast<const int *>(m_data + sizeof(CacheFileHeader)
+        + 2 * header->rows * sizeof(Pattern));
+}
+
+size_t CachedSolution::histogramSize() const
+{
+    return reinterpret_cast<const CacheFileHeader *>(m_data)->rowBits;
+}
+
+int CachedSolution::peak() const
+{
+    return reinterpret_cast<const CacheFileHeader *>(m_data)->peak;
+}
+
+int CachedSolution::bound() const
+{
+    return reinterpret_cast<const CacheFileHeader *>(m_data)->bound;
+}
+
+AnnealResult CachedSolution::anneal() const
+{
+    const CacheFileHeader *header = reinterpret_cast<const CacheFileHeader *>(m_data);
+    AnnealResult ret;
+    ret.startPeak = header->annealStartPeak;
+    ret.peak = header->annealPeak;
+    ret.bestStart = header->annealBestStart;
+    return ret;
+}
+
+ExactSearchResult CachedSolution::exact() const
+{
+    const CacheFileHeader *header = reinterpret_cast<const CacheFileHeader *>(m_data);
+    ExactSearchResult ret;
+    ret.peak = header->exactPeak;
+    ret.lowerBound = header->exactLowerBound;
+    ret.optimal = (header->exactFlags & EXACT_OPTIMAL) != 0;
+    ret.boundReached = (header->exactFlags & EXACT_BOUND_REACHED) != 0;
+    ret.nodes = header->exactNodes;
+    return ret;
+}
+
+bool storeSolution(const std::string &directory, const SolveParameters &params
+    , const SolveResult &result)
+{
+    if (result.status != SOLVE_OK || result.table.empty()) { return false; }
+
+    CacheFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.byteOrder = CACHE_BYTE_ORDER;
+    header.version = SOLUTION_CACHE_VERSION;
+    header.key = solutionCacheKey(params);
+    header.rows = static_cast<uint32_t>(result.table.size());
+    header.rowBits = static_cast<uint32_t>(result.table.bits());
+    header.peak = result.peak;
+    header.bound = result.bound;
+    if (params.anneal_starts > 0) {
+        header.annealStartPeak = result.anneal.startPeak;
+        header.annealPeak = result.anneal.peak;
+        header.annealBestStart = result.anneal.bestStart;
+    }
+    if (params.exact) {
+        header.exactPeak = result.exact.peak;
+        header.exactLowerBound = result.exact.lowerBound;
+        header.exactFlags = (result.exact.optimal ? EXACT_OPTIMAL : 0)
+            | (result.exact.boundReached ? EXACT_BOUND_REACHED : 0);
+        header.exactNodes = result.exact.nodes;
+    }
+
+    // Lay out the payload and checksum it along with the header.
+    std::vector<unsigned char> payload(payloadSize(header.rows, header.rowBits));
+    size_t tableBytes = header.rows * sizeof(Pattern);
+    memcpy(&payload[0], result.unshifted.data(), tableBytes);
+    memcpy(&payload[tableBytes], result.table.data(), tableBytes);
+    for (size_t col = 0; col < header.rowBits; col++) {
+        int32_t count = result.histogram[col];
+        memcpy(&payload[2 * tableBytes + col * sizeof(int32_t)], &count, sizeof(count));
+    }
+    header.checksum = fileChecksum(header, &payload[0], payload.size());
+
+    // Write under a temporary name and rename into place.
+#if defined(_WIN32)
+    _mkdir(directory.c_str());
+    int pid = _getpid();
+#else
+    mkdir(directory.c_str(), 0777);
+    int pid = static_cast<int>(getpid());
+#endif
+    std::string path = solutionCachePath(directory, params);
+    std::ostringstream temporary;
+    temporary << path << ".tmp" << pid;
+    {
+        std::ofstream out(temporary.str().c_str(), std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(&payload[0]), payload.size());
+        if (!out) {
+            out.close();
+            remove(temporary.str().c_str());
+            return false;
+        }
+    }
+#if defined(_WIN32)
+    if (!MoveFileExA(temporary.str().c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (rename(temporary.str().c_str(), path.c_str()) != 0) {
+#endif
+        remove(temporary.str().c_str());
+        return false;
+    }
+    return true;
+}
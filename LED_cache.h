@@ -0,0 +1,89 @@
+// Persistent on-disk cache of solved configurations.  Each solved
+// configuration is stored in its own binary file, named from a hash of
+// the parameters that affect the result, holding the unshifted pattern
+// set, the shifted table and the histogram.  Loading maps the file into
+// memory and uses the tables in place, so a cache hit skips encoding
+// and optimization and copies nothing.
+
+#ifndef LED_CACHE_H
+#define LED_CACHE_H
+
+#include "LED_solver.h"
+
+#include <string>
+
+// Version of the cache file layout; files with any other version are
+// treated as misses.
+const uint32_t SOLUTION_CACHE_VERSION = 4;
+
+// The parameters that affect a solve's result, laid out with fixed-size
+// fields and no padding so that they can be hashed and stored as-is.
+struct SolutionCacheKey
+{
+    uint32_t LEDs;
+    uint32_t bits;
+    uint32_t parity;
+    int32_t stride;
+    uint32_t stride_optimizations;
+    uint32_t simple_encoding;
+    uint32_t anneal_starts;
+    uint32_t exact;
+    uint32_t maximize_distance;
+    uint32_t reserved;              // Zero; keeps the 64-bit fields aligned
+    uint64_t anneal_steps;
+    uint64_t seed;
+    uint64_t exact_nodes;
+};
+
+// Build the key for a set of parameters.
+SolutionCacheKey solutionCacheKey(const SolveParameters &params);
+
+// Path of the cache file for a set of parameters within a directory.
+std::string solutionCachePath(const std::string &directory, const SolveParameters &params);
+
+// A solution loaded from the cache.  The tables and histogram point
+// into the mapped file and stay valid until the object is destroyed or
+// load() is called again.
+class CachedSolution
+{
+public:
+    CachedSolution();
+    ~CachedSolution();
+
+    // Map the cache file for the parameters from the directory and check
+    // its version, parameters, size and checksum.  Returns false (and
+    // holds nothing) if there is no valid entry.
+    bool load(const std::string &directory, const SolveParameters &params);
+
+    bool loaded() const { return m_data != 0; }
+
+    PatternView unshifted() const;
+    PatternView table() const;
+    const int *histogram() const;
+    size_t histogramSize() const;
+    int peak() const;
+    int bound() const;
+    AnnealResult anneal() const;
+    ExactSearchResult exact() const;
+
+private:
+    CachedSolution(const CachedSolution &);
+    CachedSolution &operator=(const CachedSolution &);
+    void unmap();
+
+    const unsigned char *m_data;
+    size_t m_size;
+#if defined(_WIN32)
+    void *m_file;
+    void *m_mapping;
+#endif
+};
+
+// Store a successful solve in the cache directory, replacing any entry
+// for the same parameters.  The file is written under a temporary name
+// and then renamed, so readers never see a partial entry.  Returns
+// false if the file could not be written.
+bool storeSolution(const std::string &directory, const SolveParameters &params
+    , const SolveResult &result);
+
+#endif
@@ -0,0 +1,104 @@
+#include "LED_decoder.h"
+
+const uint32_t PatternDecoder::EMPTY_ENTRY;
+const uint32_t PatternDecoder::AMBIGUOUS_ENTRY;
+const uint32_t PatternDecoder::PERIODIC_PHASE;
+
+PatternDecoder::PatternDecoder()
+    : m_bits(0)
+    , m_LEDs(0)
+    , m_mask(0)
+    , m_direct(true)
+    , m_shift(0)
+    , m_windows(0)
+    , m_ambiguous(0)
+{
+}
+
+PatternDecoder::PatternDecoder(const PatternView &table)
+    : m_bits(0)
+    , m_LEDs(0)
+    , m_mask(0)
+    , m_direct(true)
+    , m_shift(0)
+    , m_windows(0)
+    , m_ambiguous(0)
+{
+    build(table);
+}
+
+bool PatternDecoder::build(const PatternView &table)
+{
+    m_bits = table.bits();
+    m_LEDs = 0;
+    m_mask = patternMask(m_bits);
+    m_windows = 0;
+    m_ambiguous = 0;
+    m_keys.clear();
+    m_entries.clear();
+    // Row 0xFFFFFF with a periodic phase would pack to EMPTY_ENTRY.
+    if (table.size() >= (1u << 24) - 1) { return false; }
+    m_LEDs = table.size();
+
+    m_direct = m_bits <= DIRECT_DECODE_MAX_BITS;
+    if (m_direct) {
+        m_entries.assign(static_cast<size_t>(1) << m_bits, EMPTY_ENTRY);
+    }
+    else {
+        // Keep the hash table at most a quarter full, so that probe
+        // sequences stay short.  Starting at two slots keeps the shift
+        // in slot() below 64 even for an empty table.
+        size_t capacity = 2;
+        m_shift = 63;
+        while (capacity < 4 * m_LEDs * m_bits) {
+            capacity *= 2;
+            m_shift--;
+        }
+        m_keys.assign(capacity, 0);
+        m_entries.assign(capacity, EMPTY_ENTRY);
+    }
+
+    for (size_t row = 0; row < m_LEDs; row++) {
+        for (size_t phase = 0; phase < m_bits; phase++) {
+            insert(rotatePattern(table[row], phase, m_bits)
+                , static_cast<uint32_t>(row << 8 | phase));
+        }
+    }
+    return true;
+}
+
+void PatternDecoder::insert(Pattern window, uint32_t entry)
+{
+    size_t i;
+    if (m_direct) {
+        i = static_cast<size_t>(window);
+    }
+    else {
+        for (i = slot(window); m_entries[i] != EMPTY_ENTRY && m_keys[i] != window; ) {
+            i = (i + 1) & (m_keys.size() - 1);
+        }
+        m_keys[i] = window;
+    }
+
+    uint32_t &current = m_entries[i];
+    if (current == EMPTY_ENTRY) {
+        current = entry;
+        m_windows++;
+    }
+    else if (current == AMBIGUOUS_ENTRY) {
+        // Already shared by several LEDs.
+    }
+    else if ((current >> 8) == (entry >> 8)) {
+        // The same LED seen at another phase: its row is periodic.
+        current |= PERIODIC_PHASE;
+    }
+    else {
+        current = AMBIGUOUS_ENTRY;
+        m_ambiguous++;
+    }
+}
+
+size_t PatternDecoder::memoryBytes() const
+{
+    return m_keys.size() * sizeof(Pattern) + m_entries.size() * sizeof(uint32_t);
+}
@@ -0,0 +1,144 @@
+// Decoder for a shifted encoding table.  The tracker sees each LED as a
+// window of 'bits' consecutive bright/dark observations, which is some
+// rotation of that LED's row in the table; the decoder maps the packed
+// window straight back to the LED and the rotation (phase) it was seen
+// at.  Small windows use a directly-indexed table; larger ones use an
+// open-addressing hash table of the windows that can occur.
+
+#ifndef LED_DECODER_H
+#define LED_DECODER_H
+
+#include "LED_solver.h"
+
+#include <algorithm>
+#include <vector>
+
+// Windows with at most this many bits are decoded with a table indexed
+// by the window itself (4 bytes per possible window).
+const size_t DIRECT_DECODE_MAX_BITS = 22;
+
+// What a window decodes to.  'LED' is the row in the table, or one of
+// the DECODE_ values below; 'phase' is the field of the row that the
+// window starts at, or -1 if the row is periodic and so several phases
+// give the same window.
+struct DecodedWindow
+{
+    int LED;
+    int phase;
+};
+
+// The window is not a rotation of any row.
+const int DECODE_UNKNOWN = -1;
+
+// The window is a rotation of more than one row.
+const int DECODE_AMBIGUOUS = -2;
+
+class PatternDecoder
+{
+public:
+    PatternDecoder();
+    explicit PatternDecoder(const PatternView &table);
+
+    // Build the decoder for every rotation of every row of the table,
+    // replacing what was there.  Returns false if the table has too
+    // many rows to be packed into an entry.
+    bool build(const PatternView &table);
+
+    size_t bits() const { return m_bits; }
+    size_t size() const { return m_LEDs; }
+
+    // True if the decoder is a directly-indexed table.
+    bool direct() const { return m_direct; }
+
+    // How many distinct windows can be seen, and how many of them are
+    // shared by several LEDs (and so decode as DECODE_AMBIGUOUS).
+    size_t windows() const { return m_windows; }
+    size_t ambiguousWindows() const { return m_ambiguous; }
+
+    // Bytes used by the lookup structure.
+    size_t memoryBytes() const;
+
+    // Visit every window that can be seen, in increasing order, as
+    // visitor(window, decoded).
+    template <class Visitor>
+    void forEachWindow(Visitor &visitor) const;
+
+    DecodedWindow decode(Pattern window) const
+    {
+        return unpack(lookup(window & m_mask));
+    }
+
+private:
+    // Entries hold the LED in the upper 24 bits and the phase in the
+    // lower 8, with these reserved values.  LED 0xFFFFFF is never used,
+    // so that no entry can equal them.
+    static const uint32_t EMPTY_ENTRY = 0xFFFFFFFFu;
+    static const uint32_t AMBIGUOUS_ENTRY = 0xFFFFFFFEu;
+    static const uint32_t PERIODIC_PHASE = 0xFFu;
+
+    static DecodedWindow unpack(uint32_t entry)
+    {
+        DecodedWindow ret;
+        if (entry == EMPTY_ENTRY) {
+            ret.LED = DECODE_UNKNOWN;
+            ret.phase = -1;
+        }
+        else if (entry == AMBIGUOUS_ENTRY) {
+            ret.LED = DECODE_AMBIGUOUS;
+            ret.phase = -1;
+        }
+        else {
+            ret.LED = static_cast<int>(entry >> 8);
+            ret.phase = ((entry & 0xFF) == PERIODIC_PHASE) ? -1 : static_cast<int>(entry & 0xFF);
+        }
+        return ret;
+    }
+
+    size_t slot(Pattern window) const
+    {
+        return static_cast<size_t>((window * 0x9E3779B97F4A7C15ULL) >> m_shift);
+    }
+
+    uint32_t lookup(Pattern window) const
+    {
+        // Nothing was built, or building failed.
+        if (m_entries.empty()) { return EMPTY_ENTRY; }
+        if (m_direct) { return m_entries[static_cast<size_t>(window)]; }
+        for (size_t i = slot(window); ; i = (i + 1) & (m_keys.size() - 1)) {
+            if (m_entries[i] == EMPTY_ENTRY || m_keys[i] == window) { return m_entries[i]; }
+        }
+    }
+
+    void insert(Pattern window, uint32_t entry);
+
+    size_t m_bits;
+    size_t m_LEDs;
+    Pattern m_mask;
+    bool m_direct;
+    unsigned m_shift;
+    size_t m_windows;
+    size_t m_ambiguous;
+    std::vector<Pattern> m_keys;        // Only used by the hash table
+    std::vector<uint32_t> m_entries;
+};
+
+template <class Visitor>
+void PatternDecoder::forEachWindow(Visitor &visitor) const
+{
+    if (m_direct) {
+        for (size_t w = 0; w < m_entries.size(); w++) {
+            if (m_entries[w] != EMPTY_ENTRY) { visitor(static_cast<Pattern>(w), unpack(m_entries[w])); }
+        }
+        return;
+    }
+    std::vector<Pattern> windows;
+    for (size_t i = 0; i < m_keys.size(); i++) {
+        if (m_entries[i] != EMPTY_ENTRY) { windows.push_back(m_keys[i]); }
+    }
+    std::sort(windows.begin(), windows.end());
+    for (size_t i = 0; i < windows.size(); i++) {
+        visitor(windows[i], decode(windows[i]));
+    }
+}
+
+#endif
@@ -1,405 +1,267 @@
+// Command-line front end for the LED encoding solver: parses the
+// options, runs solve() and prints the resulting tables.
+
+#include "LED_solver.h"
+#include "LED_cache.h"
+#include "LED_decoder.h"
+#include "LED_stats.h"
+#include "LED_output.h"
+#include "LED_simulator.h"
+
 #include <stdlib.h>
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <sstream>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 void Usage(std::string name)
 {
-    std::cout << "Usage: " << name << " [-simple_encoding] [-parity N] [-stride N] [-stride_optimize N] [-LEDs N] [-bits N] [-csv] [-array [L]]" << std::endl;
+    std::cout << "Usage: " << name << " [-simple_encoding] [-parity N] [-stride N] [-stride_optimize N] [-LEDs N] [-bits N] [-anneal [N]] [-anneal_steps N] [-seed N] [-exact [N]] [-time_budget S] [-trajectory] [-distance] [-simulate N] [-flip P] [-drop P] [-slip P] [-accept_distance D] [-maximize_distance] [-sweep] [-batch] [-capacity] [-warm FILE] [-cache DIR] [-stats FILE] [-threads N] [-csv] [-array [L]] [-skip L] [-hex] [-binary FILE] [-decoder]" << std::endl;
     std::cout << "       -simple_encoding: Use simple encoding (default not)" << std::endl;
     std::cout << "       -parity: For non-simple encoding, use even (2), odd (1) or no (0) parity (default 2)" << std::endl;
     std::cout << "       -stride: How many fields to shift between LEDs (default is to optimize)" << std::endl;
     std::cout << "       -stride_optimize: How many iterations to try optimizing strides (default is 20)" << std::endl;
     std::cout << "       -LEDs: How many LEDs are we encoding (default 40)" << std::endl;
     std::cout << "       -bits: How many bitss to use for encoding (default 10)" << std::endl;
+    std::cout << "       -anneal: Improve the result with N independent simulated-annealing runs (default 8)" << std::endl;
+    std::cout << "       -anneal_steps: How many moves each annealing run makes (default 100000)" << std::endl;
+    std::cout << "       -seed: Random seed for annealing (default 0)" << std::endl;
+    std::cout << "       -exact: Search exhaustively for the minimum brightness, optionally stopping after N search nodes" << std::endl;
+    std::cout << "       -time_budget: Stop shifting and searching after S seconds, keeping the best table found so far (default no limit); with -anneal_steps 0, annealing runs until then" << std::endl;
+    std::cout << "       -trajectory: Report when, and in which phase, the maximum brightness fell while shifting and searching" << std::endl;
+    std::cout << "       -distance: Report the smallest Hamming distance between any two LEDs' patterns under rotation" << std::endl;
+    std::cout << "       -simulate: Estimate the decoding error rates by watching each LED through N noisy windows, decoding each as the LED with the nearest rotation" << std::endl;
+    std::cout << "       -flip: Chance that -simulate misreads each field (default 0.01)" << std::endl;
+    std::cout << "       -drop: Chance that -simulate drops each frame, skipping a field (default 0)" << std::endl;
+    std::cout << "       -slip: Chance that -simulate slips the phase at each frame, seeing a field twice or skipping it (default 0)" << std::endl;
+    std::cout << "       -accept_distance: Windows farther than D from every LED's rotations are rejected by -simulate (default any distance)" << std::endl;
+    std::cout << "       -maximize_distance: Pick the patterns with the most bits to be far apart; implies -distance" << std::endl;
+    std::cout << "       -sweep: Treat -LEDs, -bits, -parity and -stride as ranges (A:B[:step], comma-separated) and print a CSV line for each combination" << std::endl;
+    std::cout << "       -batch: Solve requests read from standard input, one per line as an ID then solve options (-LEDs, -bits, -parity, -stride, -stride_optimize, -simple_encoding, -anneal, -anneal_steps, -seed, -exact, -time_budget, -maximize_distance, -threads), on -threads workers; print each result as a line of JSON when it is done.  Options on the command line set the defaults" << std::endl;
+    std::cout << "       -capacity: Print how many LEDs the bits and parity can encode, the fewest bits for the LEDs and their least total weight, without building the table" << std::endl;
+    std::cout << "       -warm: Start from the shifted table in the CSV output (-csv) of an earlier run, keeping the rows whose patterns are unchanged and placing only the rest; -stride_optimize defaults to 0" << std::endl;
+    std::cout << "       -cache: Load the result from DIR if it was solved before, otherwise store it there" << std::endl;
+    std::cout << "       -stats: Write the time spent in each phase and the work done as JSON to FILE (- for standard output)" << std::endl;
+    std::cout << "       -threads: How many threads to use (default is one per core)" << std::endl;
     std::cout << "       -csv: Also print the table as comma-separated-values" << std::endl;
     std::cout << "       -array: Also print a C-style array, optionally specifying empty LED driver outputs using a comma-separated list" << std::endl;
+    std::cout << "       -skip: Comma-separated list of empty LED driver outputs in the firmware image" << std::endl;
+    std::cout << "       -hex: Also print the firmware image in hex, one time step per line" << std::endl;
+    std::cout << "       -binary: Write the firmware image to FILE as raw bytes" << std::endl;
+    std::cout << "       -decoder: Also print the decoder table mapping each observed window to its LED and phase" << std::endl;
     exit(-1);
 }
 
 
-// Compute parity of unsigned n. It returns 1
-// if n has odd parity, and returns 0 if n has even
-// parity.
-bool hasOddParity(unsigned int n)
-{
-    bool parity = 0;
-    while (n) {
-        parity = !parity;
-        n = n & (n - 1);
-    }
-    return parity;
-}
-
-// Fill a vector of fields with the encoding of an LED's pattern.  The
-// list consists of high-power (1) and low-power (0) fields encoded
-// as described in the "OSVR: HDK LED Patterns" document.
-// If there are not enough bits to encode the pattern, returns an
-// empty vector.
-std::vector<int> encodePattern(unsigned int ID, size_t bits)
+// Add a comma-separated list of empty LED driver outputs to 'skip'.
+void parseSkipList(const std::string &list, std::vector<int> &skip)
 {
-    std::vector<int> ret;
-
-    // If we don't have enough bits to encode, return empty.
-    if (ID >= (static_cast<unsigned int>(1) << bits)) { return ret; }
-
-    // Encode the start-of-frame marker
-    ret.push_back(1);
-    ret.push_back(1);
-
-    // Encode the parity bit.
-    ret.push_back(0);
-    if (hasOddParity(ID)) {
-        ret.push_back(1);
-    }
-    else {
-        ret.push_back(0);
-    }
-
-    // Encode the data bits, MSB first.
-    for (unsigned int myBit = (1 << (bits - 1) ); myBit > 0; myBit >>= 1) {
-        ret.push_back(0);
-        if ((ID & myBit) != 0) {
-            ret.push_back(1);
-        }
-        else {
-            ret.push_back(0);
-        }
-    }
-
-    // Encode the stop bit
-    ret.push_back(0);
-    ret.push_back(0);
+    std::stringstream leds(list);
+    std::string segment;
 
-    return ret;
+    while (std::getline(leds, segment, ','))
+        skip.push_back(atoi(segment.c_str()));
 }
 
-// Returns true if the test vector is not the same as any of the
-// vectors already in the table for any rotation of the test vector.
-bool isRotationallyInvariant(std::vector<int> testVec, const std::vector< std::vector<int> > &table)
+// Print one line of the decoder table.
+class PrintDecodedWindow
 {
-    // If any of the rotations match, return false.
-    for (size_t r = 0; r < testVec.size(); r++) {
-        for (size_t t = 0; t < table.size(); t++) {
-            if (testVec == table[t]) { return false; }
-        }
-        std::rotate(testVec.begin()
-            , testVec.begin() + 1
-            , testVec.end());
+public:
+    PrintDecodedWindow(OutputWriter &out, size_t bits) : m_out(out), m_digits((bits + 3) / 4) {}
+    void operator()(Pattern window, DecodedWindow decoded)
+    {
+        m_out << "{0x";
+        m_out.hex(window, m_digits) << "," << decoded.LED << "," << decoded.phase << "},\n";
     }
-    return true;
-}
-
-// Recursively construct all of the rotationally-invariant b-bit patterns with
-// "ones" of the bits being 1.  It is called with the number of 1 bits remaining
-// to be filled in, the first location where it is legal to put a 1 bit, and
-// a vector of the encoding size filled with 0's.
-void recursiveRotationallyInvariant(
-    std::vector< std::vector<int> > &table  // The table we're filling in with results
-    , std::vector<int> testVec              // The vector we're building to test
-    , size_t ones                           // How many 1's we have left to add
-    , size_t first                          // The first location we can put a 1
-    )
+private:
+    OutputWriter &m_out;
+    size_t m_digits;
+};
+
+// Write the run statistics as JSON to a file, or to standard output if
+// the name is "-".
+void writeStats(const std::string &name)
 {
-    // How many bits are we using to encode?
-    size_t bits = testVec.size();
-
-    // Have we filled in all of our 1's?  If so, check our guess against the
-    // current ones to see if it is rotationally symmetric with any of them.
-    // If not, add it to the list.  In any case, return because we're done.
-    if (ones == 0) {
-        if (isRotationallyInvariant(testVec, table)) {
-            table.push_back(testVec);
-        }
+    if (name == "-") {
+        runStats().writeJSON(std::cout);
+        std::cout << std::endl;
         return;
     }
-
-    // Try adding a 1 in all of the possible locations (leaving room for the
-    // remainder of the bits) and recursing with one fewer bit.  Then remove
-    // the 1 from where we put it.
-    for (size_t i = first; i + ones <= bits; i++) {
-        testVec[i] = 1;
-        recursiveRotationallyInvariant(table, testVec, ones - 1, i + 1);
-        testVec[i] = 0;
-    }
-}
-
-// Construct all of the rotationally-invariant b-bit patterns with
-// "ones" of the bits being 1.
-std::vector< std::vector<int> > constructRotationallyInvariant(size_t ones, size_t bits)
-{
-    // Construct an empty table to pass to the recursive function.
-    std::vector< std::vector<int> > ret;
-
-    // Construct a vector of all 0's to send to the recursive function.
-    std::vector<int> zeroVector;
-    for (size_t i = 0; i < bits; i++) {
-        zeroVector.push_back(0);
+    std::ofstream out(name.c_str());
+    runStats().writeJSON(out);
+    out << std::endl;
+    if (!out) {
+        std::cerr << "Could not write statistics to " << name << std::endl;
     }
-    recursiveRotationallyInvariant(ret, zeroVector, ones, 0);
-    return ret;
 }
 
-// Find an optimal encoding for 'LEDs' count of LEDs in 'bits' bits.
-// It starts with the smallest number of "1" bits and includes all
-// encodings with that number of bits that are not rotationally
-// symmetric with each other, then moves up to a larger number of
-// "1" bits until it has found enough values to encode the requested
-// number of LEDs.
-//   The parity can be specified as 0 (none), 1 (odd), or 2 (even).
-// If specified, only patterns with the designated parity will be
-// included.
-//   Returns an empty vector if it cannot find enough encodings
-// matching the specified constraints.
-std::vector< std::vector<int> > greedyOptimalEncode(size_t LEDs, size_t bits, unsigned parity)
+// Parse a batch request line, "ID option...", where the options are the
+// ones that set solve parameters and apply on top of 'params'.  Returns
+// false if an option is unknown or a value is missing.
+bool parseBatchRequest(const std::string &line, std::string &id, SolveParameters &params)
 {
-    std::vector< std::vector<int> > ret;
-    if (LEDs == 0) { return ret; }
-
-    for (size_t b = 1; b <= bits; b++) {
-        // Make sure our parity matches that specified
-        if ( ((parity == 1) && (b % 2 != 1)) ||
-             ((parity == 2) && (b % 2 != 0)) ) {
-            continue;
+    std::istringstream words(line);
+    std::vector<std::string> args;
+    std::string word;
+    while (words >> word) { args.push_back(word); }
+    if (args.empty() || args[0][0] == '-') { return false; }
+    id = args[0];
+
+    for (size_t i = 1; i < args.size(); i++) {
+        const std::string &option = args[i];
+        bool hasValue = (i + 1 < args.size()) && args[i + 1][0] != '-';
+        if (option == "-simple_encoding") { params.simple_encoding = true; }
+        else if (option == "-maximize_distance") { params.maximize_distance = true; }
+        else if (option == "-anneal") {
+            params.anneal_starts = hasValue ? atoi(args[++i].c_str()) : 8;
         }
-
-        // Construct all of the b-bit patterns that are not rotationally
-        // symmetric with one another.  Add them to the list.  If we
-        // fill up all the ones we need, return.
-        std::vector< std::vector<int> > bBitPatterns =
-            constructRotationallyInvariant(b, bits);
-        for (size_t i = 0; i < bBitPatterns.size(); i++) {
-            ret.push_back(bBitPatterns[i]);
-            if (ret.size() == LEDs) { return ret; }
-        }
-    }
-
-    // We cannot succeed because we don't have enough bits, so return an empty
-    // result.
-    ret.clear();
-    return ret;
-}
-
-// Print out an encoding table in human-readible format.
-void printTable(std::vector< std::vector<int> > table)
-{
-    for (size_t row = 0; row < table.size(); row++) {
-        std::cout.width(3);
-        std::cout.fill(' ');
-        std::cout << row << ": ";
-        std::cout.width(0);
-        for (size_t col = 0; col < table[row].size(); col++) {
-            if (table[row][col] != 0) {
-                std::cout << "*";
-            }
-            else {
-                std::cout << ".";
-            }
+        else if (option == "-exact") {
+            params.exact = true;
+            if (hasValue) { params.exact_nodes = strtoull(args[++i].c_str(), NULL, 10); }
         }
-        std::cout << std::endl;
-    }
-}
-
-// Print out an encoding table as comma-separated values.
-void printTableCSV(std::vector< std::vector<int> > table)
-{
-    for (size_t row = 0; row < table.size(); row++) {
-        for (size_t col = 0; col < table[row].size(); col++) {
-            if (table[row][col] != 0) {
-                std::cout << "1,";
-            }
-            else {
-                std::cout << "0,";
-            }
-        }
-        std::cout << std::endl;
+        else if (i + 1 >= args.size()) { return false; }
+        else if (option == "-LEDs") { params.LEDs = atoi(args[++i].c_str()); }
+        else if (option == "-bits") { params.bits = atoi(args[++i].c_str()); }
+        else if (option == "-parity") { params.parity = atoi(args[++i].c_str()); }
+        else if (option == "-stride") { params.stride = atoi(args[++i].c_str()); }
+        else if (option == "-stride_optimize") { params.stride_optimizations = atoi(args[++i].c_str()); }
+        else if (option == "-anneal_steps") { params.anneal_steps = strtoull(args[++i].c_str(), NULL, 10); }
+        else if (option == "-seed") { params.seed = strtoull(args[++i].c_str(), NULL, 10); }
+        else if (option == "-time_budget") { params.time_budget = atof(args[++i].c_str()); }
+        else if (option == "-threads") { params.threads = atoi(args[++i].c_str()); }
+        else { return false; }
     }
+    return true;
 }
 
-// Print out an encoding table as a decimal array.
-void printTableArray(std::vector< std::vector<int> > table)
+// Write a string as a JSON string.  Request IDs contain no white space,
+// so only quotes and backslashes need escaping.
+void writeJSONString(OutputWriter &out, const std::string &text)
 {
-    size_t rowLength = table[0].size();
-    for (size_t col = 0; col < rowLength; col++) {
-        int code = 0;
-        std::cout << "{";
-        for (size_t row = table.size() - 1; row < table.size(); row--) {
-            code |= table[row][col] << (row % 8);
-            if (row % 8 == 0)
-            {
-                std::cout << code;
-                code = 0;
-                if (row > 0)
-                    std::cout << ",";
-            }
-        }
-        std::cout << "}," << std::endl;
+    out << '"';
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '"' || text[i] == '\\') { out << '\\'; }
+        out << text[i];
     }
+    out << '"';
 }
 
-// Compute a vector that is a histogram of column sums
-// for a table.  Optionally, specify the number of rows.
-// If the number of rows is specified as 0, all rows in
-// the table are used.
-std::vector<int> columnSums(std::vector< std::vector<int> > table, size_t nRows = 0)
+// Solve the requests read from standard input, one per line, on a pool
+// of 'workers' threads that share a pattern cache, and print each
+// result as one line of JSON as soon as it is done.  Results come out
+// in the order they finish, tagged with the request's ID.  Blank lines
+// and lines starting with '#' are skipped.
+void runBatch(const SolveParameters &defaults, unsigned workers)
 {
-    std::vector<int> ret;
-    size_t rowLength = table[0].size();
-    if (nRows == 0) { nRows = table.size(); }
-    for (size_t col = 0; col < rowLength; col++) {
-        unsigned brightCount = 0;
-        for (size_t row = 0; row < nRows; row++) {
-            if (table[row][col] != 0) {
-                brightCount++;
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque<std::string> queue;
+    bool inputDone = false;
+    std::mutex outputMutex;
+    NecklaceCache necklaces;
+
+    std::vector<std::thread> pool;
+    for (unsigned w = 0; w < workers; w++) {
+        pool.push_back(std::thread([&]() {
+            SolveScratch scratch;
+            scratch.necklaces = &necklaces;
+            SolveResult result;
+            for (;;) {
+                std::string line;
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    queueReady.wait(lock, [&]() { return inputDone || !queue.empty(); });
+                    if (queue.empty()) { return; }
+                    line = queue.front();
+                    queue.pop_front();
+                }
+
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                std::string id;
+                SolveParameters params(defaults);
+                const char *status = "bad_request";
+                if (parseBatchRequest(line, id, params)) {
+                    switch (solve(params, result, scratch)) {
+                    case SOLVE_OK: status = "ok"; break;
+                    case SOLVE_BAD_PARAMETERS: status = "bad_parameters"; break;
+                    case SOLVE_NOT_ENOUGH_BITS: status = "not_enough_bits"; break;
+                    }
+                }
+                double seconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+
+                std::lock_guard<std::mutex> lock(outputMutex);
+                OutputWriter out(std::cout);
+                out << "{\"id\": ";
+                writeJSONString(out, id);
+                out << ", \"status\": \"" << status << "\"";
+                if (std::string("ok") == status) {
+                    out << ", \"max_brightness\": " << result.peak
+                        << ", \"theoretical_minimum\": " << result.bound
+                        << ", \"timed_out\": " << (result.timedOut ? "true" : "false")
+                        << ", \"table\": [";
+                    const PatternTable &table = result.table;
+                    for (size_t row = 0; row < table.size(); row++) {
+                        out << (row == 0 ? "\"" : ", \"");
+                        for (size_t col = 0; col < table.bits(); col++) {
+                            out << (patternField(table[row], col, table.bits()) ? '1' : '0');
+                        }
+                        out << '"';
+                    }
+                    out << "]";
+                }
+                out << ", \"seconds\": " << seconds << "}\n";
+                out.flush();
             }
-        }
-        ret.push_back(brightCount);
+        }));
     }
-    return ret;
-}
 
-void applyFixedStride(int stride, std::vector< std::vector<int> > &table)
-{
-    if (table.size() == 0) { return; }
-
-    size_t rowLength = table[0].size();
-    for (size_t i = 1; i < table.size(); i++) {
-        size_t newFirst = (i * stride) % rowLength;
-        newFirst = rowLength - newFirst;
-        std::rotate(table[i].begin()
-            , table[i].begin() + newFirst
-            , table[i].end());
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') { continue; }
+        std::lock_guard<std::mutex> lock(queueMutex);
+        queue.push_back(line);
+        queueReady.notify_one();
     }
-}
-
-// Attempt to rotate the second and following rows such that
-// the maximum number of overlapping bright LEDs in a single
-// column for that row plus all the ones above it is minimized.
-// Repeating this function will select different solutions;
-// it picks the maximum equivalent rotation each time.
-void greedyOptimumStride(std::vector< std::vector<int> > &table)
-{
-    if (table.size() == 0) { return; }
-
-    // Leave the first row un-rotated.
-    // For the following rows, pick the least-rotated choice
-    // with the minimal overlap with previous rows.
-    size_t rowLength = table[0].size();
-    for (size_t i = 1; i < table.size(); i++) {
-        // Record the initial overlap and its index, then
-        // try all of the other ones to see if any are an improvement.
-        // Keep track of the maximum rotation that has the lowest
-        // overlap count.
-        std::vector<int> overlaps = columnSums(table, i+1);
-        int minMaxOverlap = *std::max_element(overlaps.begin(), overlaps.end());
-        size_t minRotation = 0;
-        for (size_t j = 1; j < rowLength; j++) {
-            std::rotate(table[i].begin()
-                , table[i].begin() + 1
-                , table[i].end());
-
-            overlaps = columnSums(table, i+1);
-            int thisMaxOverlap = *std::max_element(overlaps.begin(), overlaps.end());
-            if (thisMaxOverlap <= minMaxOverlap) {
-                minMaxOverlap = thisMaxOverlap;
-                minRotation = j;
-            }
-        }
-
-        // Rotate back to the original position.
-        std::rotate(table[i].begin()
-            , table[i].begin() + 1
-            , table[i].end());
-
-        // Rotate by the best amount to reach minimum.
-        if (minRotation != 0) {
-            std::rotate(table[i].begin()
-                , table[i].begin() + minRotation
-                , table[i].end());
-        }
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        inputDone = true;
     }
-}
-
-// Attempt to rotate all rows such that the maximum number of
-// overlapping bright LEDs in a single column is minimized.
-// It also attempts to maximize the minimum maximum count over
-// all columns, to try and level the number of 1's per column.
-// Repeating this function will select different solutions;
-// it picks the maximum equivalent rotation for each row
-// each time it is run.
-void greedyReduceOverlaps(std::vector< std::vector<int> > &table)
-{
-    if (table.size() == 0) { return; }
-
-    size_t rowLength = table[0].size();
-    for (size_t i = 0; i < table.size(); i++) {
-        // Record the initial overlap and its index, then
-        // try all of the other ones to see if any are an improvement.
-        // Keep track of the maximum rotation that has the lowest
-        // maximum overlap count and, within that, the largest
-        // minimum overlap count.
-        std::vector<int> overlaps = columnSums(table);
-        int minMaxOverlap = *std::max_element(overlaps.begin(), overlaps.end());
-        int maxMinOverlap = *std::min_element(overlaps.begin(), overlaps.end());
-        size_t minRotation = 0;
-        for (size_t j = 1; j < rowLength; j++) {
-            std::rotate(table[i].begin()
-                , table[i].begin() + 1
-                , table[i].end());
-
-            overlaps = columnSums(table);
-            int thisMaxOverlap = *std::max_element(overlaps.begin(), overlaps.end());
-            int thisMinOverlap = *std::min_element(overlaps.begin(), overlaps.end());
-            if (thisMaxOverlap < minMaxOverlap) {
-                minMaxOverlap = thisMaxOverlap;
-                maxMinOverlap = thisMinOverlap;
-                minRotation = j;
-            }
-            if ((thisMaxOverlap == minMaxOverlap) && (thisMinOverlap >= maxMinOverlap)) {
-                minMaxOverlap = thisMaxOverlap;
-                maxMinOverlap = thisMinOverlap;
-                minRotation = j;
-            }
-        }
-
-        // Rotate back to the original position.
-        std::rotate(table[i].begin()
-            , table[i].begin() + 1
-            , table[i].end());
-
-        // Rotate by the best amount to reach minimum.
-        if (minRotation != 0) {
-            std::rotate(table[i].begin()
-                , table[i].begin() + minRotation
-                , table[i].end());
-        }
-    }
-}
-
-// Print a vector of column sums
-void printColumnSums(std::vector<int> sums)
-{
-    for (size_t i = 0; i < sums.size(); i++) {
-        std::cout.fill(' ');
-        std::cout.width(3);
-        std::cout << sums[i];
-    }
-    std::cout << std::endl;
+    queueReady.notify_all();
+    for (size_t w = 0; w < pool.size(); w++) { pool[w].join(); }
 }
 
 int main(int argc, char *argv[])
 {
     // Parse the command line to replace default parameters.
-    int stride = -1;
-    unsigned stride_optimizations = 20;
-    unsigned int LEDs = 40;
-    unsigned int bits = 10;
-    bool simple_encoding = false;
-    unsigned parity = 2;    // Even parity by default
+    SolveParameters params;
     bool print_CSV = false;
     bool print_array = false;
+    bool print_decoder = false;
+    bool print_hex = false;
+    std::string binary_file;
+    bool print_distance = false;
+    bool print_trajectory = false;
+    unsigned long long simulate_trials = 0;
+    NoiseModel noise;
+    noise.flip = 0.01;
+    int accept_distance = -1;
+    bool sweep_mode = false;
+    bool print_capacity = false;
+    bool batch_mode = false;
+    std::string cache_dir;
+    std::string stats_file;
+    std::string warm_file;
+    bool stride_optimize_set = false;
+    std::string LEDs_range("40"), bits_range("10"), parity_range("2"), stride_range("-1");
     unsigned int realParams = 0;
     std::vector<int> skip;
     for (size_t i = 1; i < argc; i++) {
@@ -407,50 +269,176 @@ int main(int argc, char *argv[])
             if (++i >= argc) {
                 Usage(argv[0]);
             }
-            LEDs = atoi(argv[i]);
+            params.LEDs = atoi(argv[i]);
+            LEDs_range = argv[i];
         }
         else if (std::string("-simple_encoding") == argv[i]) {
-            simple_encoding = true;
+            params.simple_encoding = true;
         }
         else if (std::string("-csv") == argv[i]) {
             print_CSV = true;
         }
+        else if (std::string("-decoder") == argv[i]) {
+            print_decoder = true;
+        }
         else if (std::string("-array") == argv[i]) {
             print_array = true;
 
             // Optional parameter
-            if (++i < argc && argv[i][0] != '-') {
-                std::stringstream leds(argv[i]);
-                std::string segment;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                parseSkipList(argv[++i], skip);
+            }
+        }
+        else if (std::string("-skip") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            parseSkipList(argv[i], skip);
+        }
+        else if (std::string("-hex") == argv[i]) {
+            print_hex = true;
+        }
+        else if (std::string("-binary") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            binary_file = argv[i];
+        }
+        else if (std::string("-anneal") == argv[i]) {
+            params.anneal_starts = 8;
+
+            // Optional parameter
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                params.anneal_starts = atoi(argv[++i]);
+            }
+        }
+        else if (std::string("-anneal_steps") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            params.anneal_steps = strtoull(argv[i], NULL, 10);
+        }
+        else if (std::string("-seed") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            params.seed = strtoull(argv[i], NULL, 10);
+        }
+        else if (std::string("-exact") == argv[i]) {
+            params.exact = true;
 
-                while (std::getline(leds, segment, ','))
-                    skip.push_back(atoi(segment.c_str()));
+            // Optional parameter
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                params.exact_nodes = strtoull(argv[++i], NULL, 10);
+            }
+        }
+        else if (std::string("-time_budget") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            params.time_budget = atof(argv[i]);
+        }
+        else if (std::string("-trajectory") == argv[i]) {
+            print_trajectory = true;
+        }
+        else if (std::string("-simulate") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            simulate_trials = strtoull(argv[i], NULL, 10);
+        }
+        else if (std::string("-flip") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            noise.flip = atof(argv[i]);
+        }
+        else if (std::string("-drop") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            noise.drop = atof(argv[i]);
+        }
+        else if (std::string("-slip") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            noise.slip = atof(argv[i]);
+        }
+        else if (std::string("-accept_distance") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            accept_distance = atoi(argv[i]);
+        }
+        else if (std::string("-distance") == argv[i]) {
+            print_distance = true;
+        }
+        else if (std::string("-maximize_distance") == argv[i]) {
+            params.maximize_distance = true;
+            print_distance = true;
+        }
+        else if (std::string("-batch") == argv[i]) {
+            batch_mode = true;
+        }
+        else if (std::string("-capacity") == argv[i]) {
+            print_capacity = true;
+        }
+        else if (std::string("-warm") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            warm_file = argv[i];
+        }
+        else if (std::string("-cache") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
             }
+            cache_dir = argv[i];
+        }
+        else if (std::string("-stats") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            stats_file = argv[i];
+        }
+        else if (std::string("-sweep") == argv[i]) {
+            sweep_mode = true;
+        }
+        else if (std::string("-threads") == argv[i]) {
+            if (++i >= argc) {
+                Usage(argv[0]);
+            }
+            params.threads = atoi(argv[i]);
         }
         else if (std::string("-parity") == argv[i]) {
             if (++i >= argc) {
                 Usage(argv[0]);
             }
-            parity = atoi(argv[i]);
-            if (parity > 2) { Usage(argv[0]); }
+            params.parity = atoi(argv[i]);
+            if (params.parity > 2) { Usage(argv[0]); }
+            parity_range = argv[i];
         }
         else if (std::string("-stride") == argv[i]) {
             if (++i >= argc) {
                 Usage(argv[0]);
             }
-            stride = atoi(argv[i]);
+            params.stride = atoi(argv[i]);
+            stride_range = argv[i];
         }
         else if (std::string("-stride_optimize") == argv[i]) {
             if (++i >= argc) {
                 Usage(argv[0]);
             }
-            stride_optimizations = atoi(argv[i]);
+            params.stride_optimizations = atoi(argv[i]);
+            stride_optimize_set = true;
         }
         else if (std::string("-bits") == argv[i]) {
             if (++i >= argc) {
                 Usage(argv[0]);
             }
-            bits = atoi(argv[i]);
+            params.bits = atoi(argv[i]);
+            bits_range = argv[i];
         }
         else if (argv[i][0] == '-') {
             Usage(argv[0]);
@@ -464,108 +452,286 @@ int main(int argc, char *argv[])
     if (realParams != 0) {
         Usage(argv[0]);
     }
+    if (!stats_file.empty()) {
+        runStats().reset();
+        runStats().enable(true);
+    }
 
-    // Check that things will work.
-    if (LEDs >= (static_cast<unsigned>(1) << bits)) {
-        std::cerr << "Not enough bits to encode all of the LEDs" << std::endl;
+    // In batch mode, each request is solved with one thread unless it
+    // asks for more, and the workers run the requests in parallel.
+    if (batch_mode) {
+        SolveParameters defaults(params);
+        defaults.threads = 1;
+        runBatch(defaults, params.threads > 0 ? params.threads : defaultThreadCount());
+        if (!stats_file.empty()) { writeStats(stats_file); }
+        return 0;
     }
 
-    // Fill a table with the encodings, not shifted.
-    std::vector< std::vector<int> > encodingTable;
-    if (simple_encoding) {
-        for (unsigned i = 0; i < LEDs; i++) {
-            encodingTable.push_back(encodePattern(i, bits));
+    // In sweep mode, the parameters are ranges and we print one line
+    // per combination of them.
+    if (sweep_mode) {
+        std::vector<int> LEDs_values, bits_values, parity_values, stride_values;
+        if (!parseRange(LEDs_range, LEDs_values) || !parseRange(bits_range, bits_values)
+            || !parseRange(parity_range, parity_values) || !parseRange(stride_range, stride_values)) {
+            Usage(argv[0]);
         }
-    }
-    else {
-        encodingTable = greedyOptimalEncode(LEDs, bits, parity);
+        for (size_t i = 0; i < parity_values.size(); i++) {
+            if (parity_values[i] < 0 || parity_values[i] > 2) { Usage(argv[0]); }
+        }
+        for (size_t i = 0; i < bits_values.size(); i++) {
+            if (bits_values[i] <= 0) { Usage(argv[0]); }
+        }
+        std::vector<SweepRow> rows = sweep(LEDs_values, bits_values, parity_values
+            , stride_values, params.simple_encoding, params.stride_optimizations
+            , params.threads);
+        OutputWriter out(std::cout);
+        out << "LEDs,bits,parity,stride,max_brightness,theoretical_minimum,seconds\n";
+        for (size_t i = 0; i < rows.size(); i++) {
+            const SweepRow &row = rows[i];
+            out << row.LEDs << "," << row.bits << "," << row.parity
+                << "," << row.stride << ",";
+            if (row.feasible) {
+                out << row.maxBrightness << "," << row.minimum;
+            }
+            else {
+                out << ",";
+            }
+            out << "," << row.seconds << "\n";
+        }
+        out.flush();
+        if (!stats_file.empty()) { writeStats(stats_file); }
+        return 0;
     }
 
-    // Make sure our construction worked.
-    if (encodingTable.size() == 0) {
-        std::cerr << "Could not construct table with " << bits << " bits for " << LEDs << " LEDs." << std::endl;
+    // Check that things will work, and report the capacity if asked.
+    // The patterns are counted rather than built, so this is immediate.
+    uint64_t capacity = encodingCapacity(params.bits, params.parity, params.simple_encoding);
+    size_t neededBits = minimumEncodingBits(params.LEDs, params.parity, params.simple_encoding);
+    std::string encoding = params.simple_encoding ? "the simple encoding"
+        : (params.parity == 0) ? "no parity"
+        : (params.parity == 1) ? "odd parity" : "even parity";
+    if (print_capacity) {
+        OutputWriter out(std::cout);
+        out << params.bits << " bits with " << encoding << " encode up to "
+            << capacity << " LEDs\n";
+        out << "Fewest bits for " << params.LEDs << " LEDs: ";
+        if (neededBits > 0) { out << neededBits << "\n"; }
+        else { out << "more than " << MAX_PATTERN_BITS << "\n"; }
+        uint64_t weight = encodingWeight(params.LEDs, params.bits, params.parity
+            , params.simple_encoding);
+        if (params.LEDs > 0 && params.LEDs <= capacity) {
+            size_t fields = params.simple_encoding ? encodedPatternBits(params.bits) : params.bits;
+            out << "Total 1's for " << params.LEDs << " LEDs: " << weight
+                << ", so the maximum brightness is at least "
+                << (weight + fields - 1) / fields << "\n";
+        }
+        out.flush();
+        if (!stats_file.empty()) { writeStats(stats_file); }
+        return 0;
+    }
+    if (params.LEDs > capacity) {
+        std::cerr << "Not enough bits to encode all of the LEDs: " << params.bits
+            << " bits with " << encoding << " encode up to " << capacity << " LEDs";
+        if (neededBits > 0) { std::cerr << "; " << params.LEDs << " LEDs need " << neededBits; }
+        std::cerr << std::endl;
         return -3;
     }
 
+    // Start from an earlier table if asked, or load the solution from the
+    // cache if it is there; otherwise encode and shift the table, and
+    // cache the result if asked.  A result cut short by the time budget
+    // depends on timing, so it is not cached.
+    SolveResult result;
+    CachedSolution cached;
+    if (!warm_file.empty()) {
+        PatternTable previous;
+        std::ifstream warm(warm_file.c_str());
+        if (!warm || !readTableCSV(warm, previous)) {
+            std::cerr << "Could not read a table from " << warm_file << std::endl;
+            return -1;
+        }
+        if (!stride_optimize_set) { params.stride_optimizations = 0; }
+        SolveScratch scratch;
+        if (warmSolve(params, previous, result, scratch) != SOLVE_OK) {
+            std::cerr << "Could not construct table with " << params.bits << " bits for " << params.LEDs << " LEDs." << std::endl;
+            return -3;
+        }
+    }
+    else if (cache_dir.empty() || !cached.load(cache_dir, params)) {
+        if (solve(params, result) != SOLVE_OK) {
+            std::cerr << "Could not construct table with " << params.bits << " bits for " << params.LEDs << " LEDs." << std::endl;
+            return -3;
+        }
+        if (!cache_dir.empty() && !result.timedOut && !storeSolution(cache_dir, params, result)) {
+            std::cerr << "Could not write to cache directory " << cache_dir << std::endl;
+        }
+    }
+    PatternView unshifted = cached.loaded() ? cached.unshifted() : PatternView(result.unshifted);
+    PatternView shifted = cached.loaded() ? cached.table() : PatternView(result.table);
+    const int *histogram = cached.loaded() ? cached.histogram() : result.histogram.data();
+    int peak = cached.loaded() ? cached.peak() : result.peak;
+    int bound = cached.loaded() ? cached.bound() : result.bound;
+    AnnealResult anneal = cached.loaded() ? cached.anneal() : result.anneal;
+    ExactSearchResult exact = cached.loaded() ? cached.exact() : result.exact;
+
     // Print the unshifted table.
-    std::cout << "Unshifted table: " << std::endl;
-    printTable(encodingTable);
+    std::chrono::steady_clock::time_point outputStart = std::chrono::steady_clock::now();
+    OutputWriter out(std::cout);
+    out << "Unshifted table: \n";
+    out.table(unshifted);
 
     // Compute and print the counts of high LEDs in each column.
-    std::vector<int> sums = columnSums(encodingTable);
-    std::cout << "Histogram of high LEDs per time step:" << std::endl;
-    printColumnSums(sums);
+    std::vector<int> sums = columnSums(unshifted);
+    out << "Histogram of high LEDs per time step:\n";
+    out.columnSums(sums.data(), sums.size());
 
     // Compute and print the maximum instantaneous brightness.
-    std::cout << std::endl << "Maximum brightness: "
-        << *std::max_element(sums.begin(), sums.end()) << std::endl;
-
-    // Reverse the order of the elements to put the ones with the most
-    // bits first.  This will mean that we pack the hardest ones first
-    // and have a better chance of "filling in" loose slots later,
-    // producing a more compact packing.
-    std::reverse(encodingTable.begin(), encodingTable.end());
-
-    // Shift the encodings based on the requested stride between elements.
-    // If the stride is negative, we do a greedy optimization, optionally
-    // followed by repeated attempts to improve it.
-    // If the stride is >=0, we use it consistently across the board.
-    if (stride >= 0) {
-        applyFixedStride(stride, encodingTable);
+    out << "\nMaximum brightness: "
+        << *std::max_element(sums.begin(), sums.end()) << "\n";
+
+    // Report on the warm start and the annealing and exact searches if
+    // they were run.
+    if (!warm_file.empty()) {
+        out << "Warm start: kept " << result.warm.kept << " rows, placed "
+            << result.warm.placed << ", dropped " << result.warm.dropped << "\n";
     }
-    else {
-        greedyOptimumStride(encodingTable);
+    if (params.anneal_starts > 0) {
+        out << "Annealing (" << params.anneal_starts << " starts, seed " << params.seed
+            << "): maximum brightness " << anneal.startPeak << " -> " << anneal.peak << "\n";
+    }
+    if (params.exact) {
+        out << "Exact search (" << exact.nodes << " nodes): ";
+        if (exact.optimal) {
+            out << "maximum brightness " << exact.peak << " is optimal ("
+                << (exact.boundReached ? "meets lower bound" : "search exhausted")
+                << ")\n";
+        }
+        else {
+            out << "stopped with maximum brightness " << exact.peak
+                << ", lower bound " << exact.lowerBound
+                << ", gap " << (exact.peak - exact.lowerBound) << "\n";
+        }
     }
 
-    // Try to find better strides by shifting each row by the maximum
-    // stride that doesn't make things worse.
-    for (size_t i = 0; i < stride_optimizations; i++) {
-        greedyReduceOverlaps(encodingTable);
+    if (!cached.loaded() && result.timedOut) {
+        out << "Time budget of " << params.time_budget
+            << " seconds ran out; keeping the best table found\n";
+    }
+    if (print_trajectory && !cached.loaded()) {
+        out << "Trajectory (seconds, maximum brightness, phase):\n";
+        for (size_t i = 0; i < result.trajectory.size(); i++) {
+            const TrajectoryPoint &point = result.trajectory[i];
+            out << "  " << point.seconds << " " << point.peak << " " << point.phase << "\n";
+        }
     }
 
     // Print the shifted table.
-    std::cout << "Shifted table: " << std::endl;
-    printTable(encodingTable);
+    out << "Shifted table: \n";
+    out.table(shifted);
 
-    // Compute and print the counts of high LEDs in each column.
-    sums = columnSums(encodingTable);
-    std::cout << "Histogram of high LEDs per time step:" << std::endl;
-    printColumnSums(sums);
+    // Print the counts of high LEDs in each column.
+    out << "Histogram of high LEDs per time step:\n";
+    out.columnSums(histogram, shifted.bits());
 
-    // Compute and print the maximum instantaneous brightness.
-    std::cout << std::endl << "Maximum brightness: "
-        << *std::max_element(sums.begin(), sums.end())
-        << std::endl << std::endl;
-
-    // Count up all of the 1's and compute how many (at minimum)
-    // must be lined up in a single column given the number of bits,
-    // irrespective of the rotationally-invariant coding or packing
-    // rotation chosen.
-    int numOnes = 0;
-    for (size_t i = 0; i < sums.size(); i++) {
-        numOnes += sums[i];
+    // Print the maximum instantaneous brightness.
+    out << "\nMaximum brightness: " << peak << "\n\n";
+
+    // Print the minimum possible maximum brightness.
+    out << "Theoretical minimum for packing this many 1's: "
+        << bound << "\n";
+
+    // The structure of the patterns can rule out reaching that.
+    int lowerBound = peakLowerBound(shifted);
+    if (lowerBound > bound) {
+        out << "Lower bound for these patterns: " << lowerBound << "\n";
     }
-    int minOnes = numOnes / bits;
-    if (numOnes % bits != 0) {
-        minOnes++;
+
+    // Print how close the closest two patterns are if asked.
+    if (print_distance) {
+        ScopedPhase phase("minimumRotationalDistance");
+        PairDistance distance = minimumRotationalDistance(shifted, params.threads);
+        out << "Minimum distance between patterns under rotation: " << distance.distance;
+        if (distance.distance >= 0) {
+            out << " (" << distance.pairs << " pairs, first rows "
+                << distance.first << " and " << distance.second << ")";
+        }
+        out << "\n";
+    }
+
+    // Estimate how often the tracker would misidentify the LEDs if asked,
+    // listing the most frequent confusions.
+    if (simulate_trials > 0) {
+        ScopedPhase phase("simulateDecoding");
+        SimulationResult simulation = simulateDecoding(shifted, noise, simulate_trials
+            , accept_distance, params.seed, params.threads);
+        double trials = static_cast<double>(simulation.trials);
+        out << "Decoding simulation (" << simulate_trials << " windows per LED, flip "
+            << noise.flip << ", drop " << noise.drop << ", slip " << noise.slip
+            << ", seed " << params.seed << "): " << simulation.noisy << " of "
+            << simulation.trials << " windows noisy\n";
+        out << "  correct " << simulation.correct << " (" << simulation.correct / trials << ")"
+            << ", misidentified " << simulation.misidentified
+            << " (" << simulation.misidentified / trials << ")"
+            << ", ambiguous " << simulation.ambiguous << " (" << simulation.ambiguous / trials << ")"
+            << ", rejected " << simulation.rejected << " (" << simulation.rejected / trials << ")\n";
+        const size_t MAX_CONFUSIONS = 10;
+        for (size_t i = 0; i < simulation.confusions.size() && i < MAX_CONFUSIONS; i++) {
+            const Confusion &c = simulation.confusions[i];
+            out << "  LED " << c.LED << " ";
+            if (c.decodedAs == DECODE_AMBIGUOUS) { out << "ambiguous"; }
+            else if (c.decodedAs == DECODE_UNKNOWN) { out << "rejected"; }
+            else { out << "read as LED " << c.decodedAs; }
+            out << ": " << c.count << "\n";
+        }
     }
-    std::cout << "Theoretical minimum for packing this many 1's: " << minOnes << std::endl;
 
     // Print the CSV table if asked.
     if (print_CSV) {
-        std::cout << "Shifted table: " << std::endl;
-        printTableCSV(encodingTable);
+        out << "Shifted table: \n";
+        out.tableCSV(shifted);
     }
 
-    // Print the C-style array if asked.
+    // Print the firmware image if asked, in each format requested.
     if (print_array) {
-        // Add empty patterns for empty LED driver outputs.
-        std::vector<int> empty;
-        empty.insert(empty.begin(), bits, 0);
-        for (int i = 0; i < skip.size() && skip[i] < encodingTable.size(); i++)
-            encodingTable.insert(encodingTable.begin() + skip[i], empty);
-
-        std::cout << "Firmware array: " << std::endl;
-        printTableArray(encodingTable);
+        out << "Firmware array: \n";
+        out.firmwareArray(shifted, skip);
+    }
+    if (print_hex) {
+        out << "Firmware hex: \n";
+        out.firmwareHex(shifted, skip);
+    }
+    if (!binary_file.empty()) {
+        std::ofstream binary(binary_file.c_str(), std::ios::binary);
+        OutputWriter image(binary);
+        image.firmwareBinary(shifted, skip);
+        image.flush();
+        if (!binary) {
+            std::cerr << "Could not write the firmware image to " << binary_file << std::endl;
+        }
+    }
+
+    // Print the decoder table if asked.  Ambiguous windows are listed
+    // with LED -2, and windows from periodic rows with phase -1.
+    if (print_decoder) {
+        PatternDecoder decoder;
+        if (!decoder.build(shifted)) {
+            std::cerr << "Too many LEDs to build a decoder" << std::endl;
+            return -4;
+        }
+        out << "Decoder (" << (decoder.direct() ? "direct table" : "hash table")
+            << ", " << decoder.windows() << " windows, " << decoder.ambiguousWindows()
+            << " ambiguous, " << decoder.memoryBytes() << " bytes): \n";
+        PrintDecodedWindow print(out, decoder.bits());
+        decoder.forEachWindow(print);
+    }
+
+    // Write the statistics if asked, counting everything since the
+    // unshifted table as output.
+    out.flush();
+    if (!stats_file.empty()) {
+        runStats().addPhase("output", -1, std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - outputStart).count(), -1);
+        writeStats(stats_file);
     }
+    return 0;
 }
\ No newline at end of file
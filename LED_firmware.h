@@ -0,0 +1,232 @@
+// Compile-time generation of the firmware LED pattern table.  This is a
+// header-only copy of the fixed-stride pipeline: the greedy encoding
+// (greedyEncodeInto()), the reversal and fixed stride of shiftTable()
+// with no greedyReduceOverlaps() passes, and the byte packing of the
+// -array output.  Firmware can include it and get the same bytes the
+// LED_encoding program prints for
+//     -LEDs N -bits N -parity N -stride N -stride_optimize 0 -array L
+// computed by the compiler, with no generation step.  For example:
+//
+//     typedef LEDFirmware::Table<40, 10, 2, 3, 21, 5, 17> Patterns;
+//     const auto &bytes = Patterns::image.bytes;   // [10][6] bytes
+//
+// The template arguments are the number of LEDs, bits, parity, stride,
+// the largest maximum brightness to accept, and then the empty LED
+// driver outputs.  Compilation fails if the LEDs cannot be encoded or
+// the table is brighter than allowed.
+//   It needs C++14 for loops in constexpr functions.  It depends only on
+// the standard headers, so it does not need the LED_solver library.
+// Every candidate pattern of each weight is visited, so compile time
+// grows with the number of patterns skipped before the last weight; the
+// sizes used by the HDK take well under a second.
+
+#ifndef LED_FIRMWARE_H
+#define LED_FIRMWARE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if !defined(_MSC_VER) && __cplusplus < 201402L
+#error "LED_firmware.h needs C++14 or later"
+#endif
+
+namespace LEDFirmware {
+
+    typedef uint64_t Pattern;
+
+    const size_t MAX_PATTERN_BITS = 64;
+
+    constexpr Pattern patternMask(size_t bits)
+    {
+        return (bits >= MAX_PATTERN_BITS) ? ~static_cast<Pattern>(0)
+            : (static_cast<Pattern>(1) << bits) - 1;
+    }
+
+    // As rotatePattern() in LED_solver.h.
+    constexpr Pattern rotatePattern(Pattern p, size_t k, size_t bits)
+    {
+        k %= bits;
+        return (k == 0) ? p : (((p << k) | (p >> (bits - k))) & patternMask(bits));
+    }
+
+    constexpr int patternField(Pattern p, size_t col, size_t bits)
+    {
+        return static_cast<int>((p >> (bits - 1 - col)) & 1);
+    }
+
+    // True if no rotation of 'p' is larger, so that 'p' is the pattern
+    // the necklace enumeration in LED_solver.h produces for its rotations.
+    constexpr bool isCanonical(Pattern p, size_t bits)
+    {
+        for (size_t r = 1; r < bits; r++) {
+            if (rotatePattern(p, r, bits) > p) { return false; }
+        }
+        return true;
+    }
+
+    // The next larger pattern with the same number of 1 bits (Gosper's
+    // hack); 'p' must not be 0.
+    constexpr Pattern nextSameWeight(Pattern p)
+    {
+        Pattern lowest = p & (~p + 1);
+        Pattern ripple = p + lowest;
+        return (((ripple ^ p) >> 2) / lowest) | ripple;
+    }
+
+    // Number of LED driver outputs once the empty ones in 'skip' are
+    // added to 'rows' driven ones, as firmwareOutputs() in LED_output.h
+    // counts them.  'empty' gets the outputs left empty, in increasing
+    // order, and 'emptyCount' how many there are.
+    template <size_t N>
+    constexpr size_t emptyOutputs(size_t rows, const int (&skip)[N], int (&empty)[N]
+        , size_t &emptyCount)
+    {
+        // Sort a copy of the list, then keep the distinct entries that
+        // land within the image.
+        int sorted[N] = {};
+        for (size_t i = 0; i < N; i++) {
+            size_t j = i;
+            for (; j > 0 && sorted[j - 1] > skip[i]; j--) { sorted[j] = sorted[j - 1]; }
+            sorted[j] = skip[i];
+        }
+        size_t outputs = rows;
+        emptyCount = 0;
+        for (size_t i = 0; i < N; i++) {
+            if (sorted[i] < 0 || (i > 0 && sorted[i] == sorted[i - 1])) { continue; }
+            if (static_cast<size_t>(sorted[i]) >= outputs) { break; }
+            empty[emptyCount++] = sorted[i];
+            outputs++;
+        }
+        return outputs;
+    }
+
+    template <size_t N>
+    constexpr size_t outputCount(size_t rows, const int (&skip)[N])
+    {
+        int empty[N] = {};
+        size_t emptyCount = 0;
+        return emptyOutputs(rows, skip, empty, emptyCount);
+    }
+
+    // The firmware image: for each column (time step), the fields of
+    // every LED driver output packed eight to a byte, output o in bit
+    // (o % 8), with the byte holding the highest outputs first.
+    template <size_t Bits, size_t Outputs>
+    struct Image
+    {
+        static constexpr size_t columns = Bits;
+        static constexpr size_t columnBytes = (Outputs + 7) / 8;
+
+        unsigned char bytes[Bits][(columnBytes > 0) ? columnBytes : 1];
+        int maxBrightness;              // Largest column sum of the table
+        bool complete;                  // False if there were not enough patterns
+    };
+
+    // Run the pipeline described at the top of the file.
+    template <size_t LEDs, size_t Bits, unsigned Parity, unsigned Stride
+        , size_t Outputs, size_t N>
+    constexpr Image<Bits, Outputs> buildImage(const int (&skip)[N])
+    {
+        Image<Bits, Outputs> ret{};
+
+        // Greedy encoding: the canonical patterns of each allowed weight
+        // in decreasing order, lightest weights first.  Weights are
+        // visited in increasing order of their complement, which walks
+        // the patterns of a weight downwards.
+        Pattern rows[(LEDs > 0) ? LEDs : 1] = {};
+        size_t found = 0;
+        for (size_t b = 1; b <= Bits && found < LEDs; b++) {
+            if ((Parity == 1 && b % 2 != 1) || (Parity == 2 && b % 2 != 0)) { continue; }
+            Pattern smallest = patternMask(b);
+            Pattern p = smallest << (Bits - b);
+            for (;;) {
+                if (isCanonical(p, Bits)) {
+                    rows[found++] = p;
+                    if (found == LEDs) { break; }
+                }
+                if (p == smallest) { break; }
+                p = ~nextSameWeight(~p & patternMask(Bits)) & patternMask(Bits);
+            }
+        }
+        ret.complete = (found == LEDs);
+        if (!ret.complete) { return ret; }
+
+        // Reverse to put the heaviest patterns first, then rotate row i
+        // to start i * Stride fields after the first.
+        for (size_t i = 0; i < LEDs / 2; i++) {
+            Pattern t = rows[i];
+            rows[i] = rows[LEDs - 1 - i];
+            rows[LEDs - 1 - i] = t;
+        }
+        for (size_t i = 1; i < LEDs; i++) {
+            rows[i] = rotatePattern(rows[i], Bits - (i * Stride) % Bits, Bits);
+        }
+
+        // Maximum brightness.
+        for (size_t col = 0; col < Bits; col++) {
+            int sum = 0;
+            for (size_t i = 0; i < LEDs; i++) { sum += patternField(rows[i], col, Bits); }
+            if (sum > ret.maxBrightness) { ret.maxBrightness = sum; }
+        }
+
+        // Pack the bytes, leaving the skipped outputs empty.
+        int empty[N] = {};
+        size_t emptyCount = 0;
+        emptyOutputs(LEDs, skip, empty, emptyCount);
+        size_t row = 0;
+        size_t next = 0;
+        for (size_t o = 0; o < Outputs; o++) {
+            if (next < emptyCount && static_cast<size_t>(empty[next]) == o) {
+                next++;
+                continue;
+            }
+            for (size_t col = 0; col < Bits; col++) {
+                if (patternField(rows[row], col, Bits)) {
+                    ret.bytes[col][Image<Bits, Outputs>::columnBytes - 1 - o / 8]
+                        |= static_cast<unsigned char>(1 << (o % 8));
+                }
+            }
+            row++;
+        }
+        return ret;
+    }
+
+    // The firmware table for a configuration, computed at compile time.
+    // See the top of the file.
+    template <size_t LEDs, size_t Bits, unsigned Parity, unsigned Stride
+        , int MaxBrightness, int... Skip>
+    struct Table
+    {
+        static_assert(LEDs > 0, "There must be at least one LED");
+        static_assert(Bits > 0 && Bits <= MAX_PATTERN_BITS, "Bits must be from 1 to 64");
+        static_assert(Parity <= 2, "Parity must be 0 (none), 1 (odd) or 2 (even)");
+
+        // The skip list, with an entry that is always ignored so that it
+        // is never empty.
+        static constexpr int skip[] = { Skip..., -1 };
+        static constexpr size_t outputs = outputCount(LEDs, skip);
+
+        typedef Image<Bits, outputs> ImageType;
+        static constexpr ImageType image = buildImage<LEDs, Bits, Parity, Stride, outputs>(skip);
+
+        static_assert(image.complete, "Not enough patterns to encode all of the LEDs");
+        static_assert(image.maxBrightness <= MaxBrightness
+            , "The table is brighter than the maximum brightness allowed");
+    };
+
+    template <size_t LEDs, size_t Bits, unsigned Parity, unsigned Stride, int MaxBrightness, int... Skip>
+    constexpr int Table<LEDs, Bits, Parity, Stride, MaxBrightness, Skip...>::skip[];
+
+    template <size_t LEDs, size_t Bits, unsigned Parity, unsigned Stride, int MaxBrightness, int... Skip>
+    constexpr typename Table<LEDs, Bits, Parity, Stride, MaxBrightness, Skip...>::ImageType
+        Table<LEDs, Bits, Parity, Stride, MaxBrightness, Skip...>::image;
+
+    template <size_t Bits, size_t Outputs>
+    constexpr size_t Image<Bits, Outputs>::columns;
+
+    template <size_t Bits, size_t Outputs>
+    constexpr size_t Image<Bits, Outputs>::columnBytes;
+
+} // namespace LEDFirmware
+
+#endif
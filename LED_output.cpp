@@ -0,0 +1,244 @@
+#include "LED_output.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+bool readTableCSV(std::istream &in, PatternTable &table)
+{
+    table.reset(0);
+    std::string line;
+    while (std::getline(in, line)) {
+        // Parse "f,f,...,f," with an optional final comma.
+        Pattern p = 0;
+        size_t fields = 0;
+        bool valid = true;
+        for (size_t i = 0; i < line.size() && valid; i++) {
+            char c = line[i];
+            if ((c == '0' || c == '1') && (i == 0 || line[i - 1] == ',')) {
+                if (++fields > MAX_PATTERN_BITS) { return false; }
+                p = (p << 1) | static_cast<Pattern>(c - '0');
+            }
+            else if (c == ',' && i > 0 && line[i - 1] != ',') {
+                continue;
+            }
+            else if (c == '\r' && i + 1 == line.size()) {
+                continue;
+            }
+            else {
+                valid = false;
+            }
+        }
+        if (!valid || fields == 0) { continue; }
+        if (table.empty()) {
+            table.reset(fields);
+        }
+        else if (fields != table.bits()) {
+            return false;
+        }
+        table.push_back(p);
+    }
+    return !table.empty();
+}
+
+std::vector<int> firmwareOutputs(size_t rows, const std::vector<int> &skip)
+{
+    // Find the outputs that are left empty, in increasing order; each
+    // one that lands within the image pushes the later rows out by one.
+    std::vector<int> empty(skip);
+    std::sort(empty.begin(), empty.end());
+    empty.erase(std::unique(empty.begin(), empty.end()), empty.end());
+    size_t outputs = rows;
+    size_t used = 0;
+    for (size_t i = 0; i < empty.size(); i++) {
+        if (empty[i] < 0) { continue; }
+        if (static_cast<size_t>(empty[i]) >= outputs) { break; }
+        empty[used++] = empty[i];
+        outputs++;
+    }
+    empty.resize(used);
+
+    std::vector<int> ret(outputs);
+    size_t row = 0;
+    size_t next = 0;
+    for (size_t o = 0; o < outputs; o++) {
+        if (next < empty.size() && static_cast<size_t>(empty[next]) == o) {
+            ret[o] = -1;
+            next++;
+        }
+        else {
+            ret[o] = static_cast<int>(row++);
+        }
+    }
+    return ret;
+}
+
+void firmwareColumn(const PatternView &table, const std::vector<int> &outputs
+    , size_t col, unsigned char *bytes)
+{
+    size_t count = firmwareColumnBytes(outputs.size());
+    memset(bytes, 0, count);
+    for (size_t o = 0; o < outputs.size(); o++) {
+        if (outputs[o] >= 0 && patternField(table[outputs[o]], col, table.bits())) {
+            bytes[count - 1 - o / 8] |= static_cast<unsigned char>(1 << (o % 8));
+        }
+    }
+}
+
+OutputWriter::OutputWriter(std::ostream &out, size_t blockSize)
+    : m_out(out)
+    , m_blockSize(blockSize)
+{
+    m_buffer.reserve(blockSize + 64);
+}
+
+OutputWriter::~OutputWriter()
+{
+    writeBuffer();
+}
+
+void OutputWriter::write(const char *text, size_t size)
+{
+    m_buffer.insert(m_buffer.end(), text, text + size);
+    if (m_buffer.size() >= m_blockSize) { writeBuffer(); }
+}
+
+void OutputWriter::writeBuffer()
+{
+    if (!m_buffer.empty()) {
+        m_out.write(&m_buffer[0], m_buffer.size());
+        m_buffer.clear();
+    }
+}
+
+void OutputWriter::flush()
+{
+    writeBuffer();
+    m_out.flush();
+}
+
+OutputWriter &OutputWriter::operator<<(const char *text)
+{
+    write(text, strlen(text));
+    return *this;
+}
+
+OutputWriter &OutputWriter::operator<<(const std::string &text)
+{
+    write(text.data(), text.size());
+    return *this;
+}
+
+OutputWriter &OutputWriter::operator<<(char c)
+{
+    put(c);
+    return *this;
+}
+
+OutputWriter &OutputWriter::operator<<(double value)
+{
+    // As an ostream prints it by default.
+    char text[32];
+    int size = snprintf(text, sizeof(text), "%g", value);
+    write(text, static_cast<size_t>(size));
+    return *this;
+}
+
+OutputWriter &OutputWriter::unsignedNumber(unsigned long long value)
+{
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    while (n > 0) { put(digits[--n]); }
+    return *this;
+}
+
+OutputWriter &OutputWriter::padded(long long value, size_t width)
+{
+    size_t digits = (value < 0) ? 2 : 1;
+    for (unsigned long long v = (value < 0) ? 0 - static_cast<unsigned long long>(value) : value;
+        v >= 10; v /= 10) {
+        digits++;
+    }
+    for (; digits < width; digits++) { put(' '); }
+    return *this << value;
+}
+
+OutputWriter &OutputWriter::hex(uint64_t value, size_t digits)
+{
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    while (digits-- > 0) {
+        put(HEX_DIGITS[(value >> (4 * digits)) & 0xF]);
+    }
+    return *this;
+}
+
+void OutputWriter::table(const PatternView &table)
+{
+    for (size_t row = 0; row < table.size(); row++) {
+        padded(static_cast<long long>(row), 3) << ": ";
+        for (size_t col = 0; col < table.bits(); col++) {
+            put(patternField(table[row], col, table.bits()) ? '*' : '.');
+        }
+        put('\n');
+    }
+}
+
+void OutputWriter::tableCSV(const PatternView &table)
+{
+    for (size_t row = 0; row < table.size(); row++) {
+        for (size_t col = 0; col < table.bits(); col++) {
+            write(patternField(table[row], col, table.bits()) ? "1," : "0,", 2);
+        }
+        put('\n');
+    }
+}
+
+void OutputWriter::columnSums(const int *sums, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        padded(sums[i], 3);
+    }
+    put('\n');
+}
+
+void OutputWriter::firmwareArray(const PatternView &table, const std::vector<int> &skip)
+{
+    std::vector<int> outputs = firmwareOutputs(table.size(), skip);
+    std::vector<unsigned char> bytes(firmwareColumnBytes(outputs.size()));
+    for (size_t col = 0; col < table.bits(); col++) {
+        if (!bytes.empty()) { firmwareColumn(table, outputs, col, &bytes[0]); }
+        put('{');
+        for (size_t i = 0; i < bytes.size(); i++) {
+            if (i > 0) { put(','); }
+            *this << static_cast<int>(bytes[i]);
+        }
+        write("},\n", 3);
+    }
+}
+
+void OutputWriter::firmwareHex(const PatternView &table, const std::vector<int> &skip)
+{
+    std::vector<int> outputs = firmwareOutputs(table.size(), skip);
+    std::vector<unsigned char> bytes(firmwareColumnBytes(outputs.size()));
+    for (size_t col = 0; col < table.bits(); col++) {
+        if (!bytes.empty()) { firmwareColumn(table, outputs, col, &bytes[0]); }
+        for (size_t i = 0; i < bytes.size(); i++) {
+            hex(bytes[i], 2);
+        }
+        put('\n');
+    }
+}
+
+void OutputWriter::firmwareBinary(const PatternView &table, const std::vector<int> &skip)
+{
+    std::vector<int> outputs = firmwareOutputs(table.size(), skip);
+    std::vector<unsigned char> bytes(firmwareColumnBytes(outputs.size()));
+    for (size_t col = 0; col < table.bits() && !bytes.empty(); col++) {
+        firmwareColumn(table, outputs, col, &bytes[0]);
+        write(reinterpret_cast<const char *>(&bytes[0]), bytes.size());
+    }
+}
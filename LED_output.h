@@ -0,0 +1,112 @@
+// Buffered output of encoding tables, reports and firmware images.
+// Everything is formatted into one buffer that is written to the stream
+// in large blocks, so printing a large table costs a handful of writes
+// rather than a flush per row.  Tables written as CSV can be read back.
+
+#ifndef LED_OUTPUT_H
+#define LED_OUTPUT_H
+
+#include "LED_solver.h"
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Read a table written by OutputWriter::tableCSV() into 'table',
+// replacing what was there.  Lines that are not all 0's and 1's
+// separated by commas are skipped, so the whole output of a run with
+// -csv can be read.  Returns false if there are no rows, the rows have
+// different lengths or they are longer than a Pattern.
+bool readTableCSV(std::istream &in, PatternTable &table);
+
+// Map the LED driver outputs of a firmware image to table rows.  The
+// outputs listed in 'skip' are left empty and the table's rows fill the
+// others in order; a skipped output past the last row that would be
+// driven is ignored.  Returns one entry per output: its row, or -1 if
+// it is empty.
+std::vector<int> firmwareOutputs(size_t rows, const std::vector<int> &skip);
+
+// Bytes in each column of a firmware image with this many outputs.
+inline size_t firmwareColumnBytes(size_t outputs) { return (outputs + 7) / 8; }
+
+// Pack one column (time step) of a firmware image into 'bytes'.  Output
+// o is bit (o % 8) of its byte, and the bytes run from the one holding
+// the highest-numbered outputs down to the one holding outputs 0-7.
+void firmwareColumn(const PatternView &table, const std::vector<int> &outputs
+    , size_t col, unsigned char *bytes);
+
+class OutputWriter
+{
+public:
+    explicit OutputWriter(std::ostream &out, size_t blockSize = 1 << 16);
+
+    // Writes out anything still buffered.
+    ~OutputWriter();
+
+    OutputWriter &operator<<(const char *text);
+    OutputWriter &operator<<(const std::string &text);
+    OutputWriter &operator<<(char c);
+    OutputWriter &operator<<(double value);
+
+    template <class Integer>
+    typename std::enable_if<std::is_integral<Integer>::value, OutputWriter &>::type
+    operator<<(Integer value)
+    {
+        if (value < 0) {
+            put('-');
+            return unsignedNumber(0 - static_cast<unsigned long long>(value));
+        }
+        return unsignedNumber(static_cast<unsigned long long>(value));
+    }
+
+    // A number right-aligned in a field of 'width' characters.
+    OutputWriter &padded(long long value, size_t width);
+
+    // A number as exactly 'digits' lower-case hex digits.
+    OutputWriter &hex(uint64_t value, size_t digits);
+
+    // The table with one row per line: the row number, then '*' for each
+    // 1 field and '.' for each 0 field.
+    void table(const PatternView &table);
+
+    // The table as comma-separated 1's and 0's, one row per line.
+    void tableCSV(const PatternView &table);
+
+    // Column sums on one line, three characters each.
+    void columnSums(const int *sums, size_t count);
+
+    // The firmware image as a C-style array of decimal bytes, one column
+    // per line.
+    void firmwareArray(const PatternView &table, const std::vector<int> &skip);
+
+    // The firmware image as hex, two digits per byte and one column per
+    // line, as read by "xxd -r -p".
+    void firmwareHex(const PatternView &table, const std::vector<int> &skip);
+
+    // The firmware image as raw bytes, column after column.
+    void firmwareBinary(const PatternView &table, const std::vector<int> &skip);
+
+    // Write out what is buffered and flush the stream.
+    void flush();
+
+private:
+    OutputWriter(const OutputWriter &);
+    OutputWriter &operator=(const OutputWriter &);
+
+    void put(char c)
+    {
+        m_buffer.push_back(c);
+        if (m_buffer.size() >= m_blockSize) { writeBuffer(); }
+    }
+    void write(const char *text, size_t size);
+    OutputWriter &unsignedNumber(unsigned long long value);
+    void writeBuffer();
+
+    std::ostream &m_out;
+    size_t m_blockSize;
+    std::vector<char> m_buffer;
+};
+
+#endif
@@ -0,0 +1,418 @@
+#include "LED_rotations.h"
+
+#include <limits.h>
+#include <algorithm>
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LED_ROTATIONS_X86
+#define LED_TARGET(name) __attribute__((target(name)))
+#include <immintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define LED_ROTATIONS_X86
+#define LED_TARGET(name)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+
+    const size_t MAX_BITS = 64;
+
+    // The fields of the pattern twice over, so that field col of the
+    // pattern rotated left by r is fields[col + r], followed by zeroes
+    // that the vector kernels read past the last rotation.
+    struct RotationFields
+    {
+        int fields[2 * MAX_BITS + 8];
+    };
+
+    void spreadFields(uint64_t pattern, size_t bits, RotationFields &out)
+    {
+        for (size_t col = 0; col < bits; col++) {
+            int field = static_cast<int>((pattern >> (bits - 1 - col)) & 1);
+            out.fields[col] = field;
+            out.fields[col + bits] = field;
+        }
+        for (size_t i = 2 * bits; i < sizeof(out.fields) / sizeof(out.fields[0]); i++) {
+            out.fields[i] = 0;
+        }
+    }
+
+    // Each kernel fills 'maxCounts' and 'minCounts' for the rotations
+    // from 0 up to 'bits' rounded up to its vector width, which is at
+    // most MAX_BITS.
+    typedef void (*ExtremesKernel)(const int *counts, size_t bits, const int *fields
+        , int *maxCounts, int *minCounts);
+
+    void extremesScalar(const int *counts, size_t bits, const int *fields
+        , int *maxCounts, int *minCounts)
+    {
+        for (size_t r = 0; r < bits; r++) {
+            const int *rotated = fields + r;
+            int hi = counts[0] + rotated[0];
+            int lo = hi;
+            for (size_t col = 1; col < bits; col++) {
+                int count = counts[col] + rotated[col];
+                hi = (count > hi) ? count : hi;
+                lo = (count < lo) ? count : lo;
+            }
+            maxCounts[r] = hi;
+            minCounts[r] = lo;
+        }
+    }
+
+    // Each kernel finds the patterns closest to the window.
+    typedef NearestPattern (*NearestKernel)(const uint64_t *patterns, size_t count
+        , uint64_t window);
+
+    int popcount(uint64_t x)
+    {
+#if defined(_MSC_VER) && defined(_M_X64)
+        return static_cast<int>(__popcnt64(x));
+#elif defined(__GNUC__) || defined(__clang__)
+        return __builtin_popcountll(x);
+#else
+        int count = 0;
+        for (; x; x &= x - 1) { count++; }
+        return count;
+#endif
+    }
+
+    // Fold 'count' patterns at 'distance', one of them at 'index', into
+    // a running result.
+    void mergeNearest(NearestPattern &best, int distance, size_t count, size_t index)
+    {
+        if (distance < best.distance) {
+            best.distance = distance;
+            best.count = count;
+            best.index = index;
+        }
+        else if (distance == best.distance) {
+            best.count += count;
+        }
+    }
+
+    // Compare the patterns from 'first' on, one at a time.
+    void nearestFrom(const uint64_t *patterns, size_t first, size_t count, uint64_t window
+        , NearestPattern &best)
+    {
+        for (size_t i = first; i < count; i++) {
+            mergeNearest(best, popcount(patterns[i] ^ window), 1, i);
+        }
+    }
+
+    NearestPattern noPattern()
+    {
+        NearestPattern ret;
+        ret.distance = static_cast<int>(MAX_BITS) + 1;
+        ret.count = ret.index = 0;
+        return ret;
+    }
+
+    NearestPattern nearestScalar(const uint64_t *patterns, size_t count, uint64_t window)
+    {
+        NearestPattern ret = noPattern();
+        nearestFrom(patterns, 0, count, window, ret);
+        return ret;
+    }
+
+#if defined(LED_ROTATIONS_X86)
+    // Vector lanes hold consecutive rotations, so each column adds its
+    // count to an unaligned load of the doubled fields.
+
+    LED_TARGET("sse4.1")
+    void extremesSSE41(const int *counts, size_t bits, const int *fields
+        , int *maxCounts, int *minCounts)
+    {
+        for (size_t r = 0; r < bits; r += 4) {
+            __m128i hi = _mm_set1_epi32(INT_MIN);
+            __m128i lo = _mm_set1_epi32(INT_MAX);
+            for (size_t col = 0; col < bits; col++) {
+                __m128i count = _mm_add_epi32(_mm_set1_epi32(counts[col])
+                    , _mm_loadu_si128(reinterpret_cast<const __m128i *>(fields + col + r)));
+                hi = _mm_max_epi32(hi, count);
+                lo = _mm_min_epi32(lo, count);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(maxCounts + r), hi);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(minCounts + r), lo);
+        }
+    }
+
+    LED_TARGET("avx2")
+    void extremesAVX2(const int *counts, size_t bits, const int *fields
+        , int *maxCounts, int *minCounts)
+    {
+        for (size_t r = 0; r < bits; r += 8) {
+            __m256i hi = _mm256_set1_epi32(INT_MIN);
+            __m256i lo = _mm256_set1_epi32(INT_MAX);
+            for (size_t col = 0; col < bits; col++) {
+                __m256i count = _mm256_add_epi32(_mm256_set1_epi32(counts[col])
+                    , _mm256_loadu_si256(reinterpret_cast<const __m256i *>(fields + col + r)));
+                hi = _mm256_max_epi32(hi, count);
+                lo = _mm256_min_epi32(lo, count);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(maxCounts + r), hi);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(minCounts + r), lo);
+        }
+    }
+
+    // The nearest-pattern kernels work through the patterns in chunks.
+    // The first pass over a chunk counts the bits of each difference with
+    // a table lookup per nibble, summed into one 64-bit lane per pattern,
+    // and keeps the distances and the smallest; distances are at most
+    // 64, so 32-bit minimums of the lanes are 64-bit minimums.  The
+    // second pass compares the kept distances with the smallest to count
+    // the patterns at it, and finds the first of them if it is closer
+    // than any earlier chunk's.
+    const size_t NEAREST_CHUNK = 256;
+
+    // The lowest set bit of a nonzero movemask.
+    size_t firstLane(int mask)
+    {
+        size_t lane = 0;
+        while (!((mask >> lane) & 1)) { lane++; }
+        return lane;
+    }
+
+    LED_TARGET("sse4.1")
+    NearestPattern nearestSSE41(const uint64_t *patterns, size_t count, uint64_t window)
+    {
+        const __m128i nibbleBits = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m128i lowNibbles = _mm_set1_epi8(0x0F);
+        const __m128i zero = _mm_setzero_si128();
+        __m128i w = _mm_set1_epi64x(static_cast<long long>(window));
+        __m128i distances[NEAREST_CHUNK / 2];
+        NearestPattern ret = noPattern();
+        size_t vectorCount = count & ~static_cast<size_t>(1);
+        for (size_t first = 0; first < vectorCount; first += NEAREST_CHUNK) {
+            size_t vectors = std::min(NEAREST_CHUNK, vectorCount - first) / 2;
+            __m128i lowest = _mm_set1_epi64x(static_cast<long long>(MAX_BITS) + 1);
+            for (size_t v = 0; v < vectors; v++) {
+                __m128i x = _mm_xor_si128(w
+                    , _mm_loadu_si128(reinterpret_cast<const __m128i *>(patterns + first + 2 * v)));
+                __m128i bits = _mm_add_epi8(_mm_shuffle_epi8(nibbleBits, _mm_and_si128(x, lowNibbles))
+                    , _mm_shuffle_epi8(nibbleBits, _mm_and_si128(_mm_srli_epi16(x, 4), lowNibbles)));
+                distances[v] = _mm_sad_epu8(bits, zero);
+                lowest = _mm_min_epi32(lowest, distances[v]);
+            }
+            lowest = _mm_min_epi32(lowest, _mm_unpackhi_epi64(lowest, lowest));
+            int distance = _mm_cvtsi128_si32(lowest);
+            if (distance > ret.distance) { continue; }
+            __m128i target = _mm_unpacklo_epi64(lowest, lowest);
+            __m128i hits = zero;
+            for (size_t v = 0; v < vectors; v++) {
+                hits = _mm_sub_epi64(hits, _mm_cmpeq_epi64(distances[v], target));
+            }
+            hits = _mm_add_epi64(hits, _mm_unpackhi_epi64(hits, hits));
+            size_t index = 0;
+            if (distance < ret.distance) {
+                for (size_t v = 0; v < vectors; v++) {
+                    int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(distances[v], target)));
+                    if (mask != 0) {
+                        index = first + 2 * v + firstLane(mask);
+                        break;
+                    }
+                }
+            }
+            mergeNearest(ret, distance, static_cast<size_t>(_mm_cvtsi128_si32(hits)), index);
+        }
+        nearestFrom(patterns, vectorCount, count, window, ret);
+        return ret;
+    }
+
+    LED_TARGET("avx2")
+    NearestPattern nearestAVX2(const uint64_t *patterns, size_t count, uint64_t window)
+    {
+        const __m256i nibbleBits = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+            , 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i lowNibbles = _mm256_set1_epi8(0x0F);
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i w = _mm256_set1_epi64x(static_cast<long long>(window));
+        __m256i distances[NEAREST_CHUNK / 4];
+        NearestPattern ret = noPattern();
+        size_t vectorCount = count & ~static_cast<size_t>(3);
+        for (size_t first = 0; first < vectorCount; first += NEAREST_CHUNK) {
+            size_t vectors = std::min(NEAREST_CHUNK, vectorCount - first) / 4;
+            __m256i lowest = _mm256_set1_epi64x(static_cast<long long>(MAX_BITS) + 1);
+            for (size_t v = 0; v < vectors; v++) {
+                __m256i x = _mm256_xor_si256(w
+                    , _mm256_loadu_si256(reinterpret_cast<const __m256i *>(patterns + first + 4 * v)));
+                __m256i bits = _mm256_add_epi8(
+                    _mm256_shuffle_epi8(nibbleBits, _mm256_and_si256(x, lowNibbles))
+                    , _mm256_shuffle_epi8(nibbleBits, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowNibbles)));
+                distances[v] = _mm256_sad_epu8(bits, zero);
+                lowest = _mm256_min_epi32(lowest, distances[v]);
+            }
+            __m128i half = _mm_min_epi32(_mm256_castsi256_si128(lowest)
+                , _mm256_extracti128_si256(lowest, 1));
+            half = _mm_min_epi32(half, _mm_unpackhi_epi64(half, half));
+            int distance = _mm_cvtsi128_si32(half);
+            if (distance > ret.distance) { continue; }
+            __m256i target = _mm256_broadcastq_epi64(half);
+            __m256i hits = zero;
+            for (size_t v = 0; v < vectors; v++) {
+                hits = _mm256_sub_epi64(hits, _mm256_cmpeq_epi64(distances[v], target));
+            }
+            __m128i hitsHalf = _mm_add_epi64(_mm256_castsi256_si128(hits)
+                , _mm256_extracti128_si256(hits, 1));
+            hitsHalf = _mm_add_epi64(hitsHalf, _mm_unpackhi_epi64(hitsHalf, hitsHalf));
+            size_t index = 0;
+            if (distance < ret.distance) {
+                for (size_t v = 0; v < vectors; v++) {
+                    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(distances[v], target)));
+                    if (mask != 0) {
+                        index = first + 4 * v + firstLane(mask);
+                        break;
+                    }
+                }
+            }
+            mergeNearest(ret, distance, static_cast<size_t>(_mm_cvtsi128_si32(hitsHalf)), index);
+        }
+        nearestFrom(patterns, vectorCount, count, window, ret);
+        return ret;
+    }
+
+    bool cpuHasSSE41()
+    {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 19)) != 0;
+#else
+        return __builtin_cpu_supports("sse4.1") != 0;
+#endif
+    }
+
+    bool cpuHasAVX2()
+    {
+#if defined(_MSC_VER)
+        // The operating system must also save the AVX registers.
+        int info[4];
+        __cpuid(info, 1);
+        const int osxsaveAndAVX = (1 << 27) | (1 << 28);
+        if ((info[2] & osxsaveAndAVX) != osxsaveAndAVX) { return false; }
+        if ((_xgetbv(0) & 6) != 6) { return false; }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2") != 0;
+#endif
+    }
+#endif
+
+    RotationKernel fastestKernel()
+    {
+        if (rotationKernelSupported(ROTATION_KERNEL_AVX2)) { return ROTATION_KERNEL_AVX2; }
+        if (rotationKernelSupported(ROTATION_KERNEL_SSE41)) { return ROTATION_KERNEL_SSE41; }
+        return ROTATION_KERNEL_SCALAR;
+    }
+
+    std::atomic<int> &currentKernel()
+    {
+        static std::atomic<int> kernel(static_cast<int>(fastestKernel()));
+        return kernel;
+    }
+
+    // Fill 'maxCounts' and 'minCounts', which must have room for MAX_BITS
+    // entries, for every rotation.
+    void allExtremes(const int *counts, size_t bits, uint64_t pattern
+        , int *maxCounts, int *minCounts)
+    {
+        RotationFields spread;
+        spreadFields(pattern, bits, spread);
+        ExtremesKernel kernel = extremesScalar;
+        switch (currentKernel().load(std::memory_order_relaxed)) {
+#if defined(LED_ROTATIONS_X86)
+        case ROTATION_KERNEL_SSE41: kernel = extremesSSE41; break;
+        case ROTATION_KERNEL_AVX2: kernel = extremesAVX2; break;
+#endif
+        default: break;
+        }
+        kernel(counts, bits, spread.fields, maxCounts, minCounts);
+    }
+}
+
+bool rotationKernelSupported(RotationKernel kernel)
+{
+    switch (kernel) {
+    case ROTATION_KERNEL_SCALAR:
+        return true;
+#if defined(LED_ROTATIONS_X86)
+    case ROTATION_KERNEL_SSE41:
+        return cpuHasSSE41();
+    case ROTATION_KERNEL_AVX2:
+        return cpuHasAVX2();
+#endif
+    default:
+        return false;
+    }
+}
+
+RotationKernel rotationKernel()
+{
+    return static_cast<RotationKernel>(currentKernel().load());
+}
+
+const char *rotationKernelName(RotationKernel kernel)
+{
+    switch (kernel) {
+    case ROTATION_KERNEL_SCALAR: return "scalar";
+    case ROTATION_KERNEL_SSE41: return "sse4.1";
+    case ROTATION_KERNEL_AVX2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool setRotationKernel(RotationKernel kernel)
+{
+    if (!rotationKernelSupported(kernel)) { return false; }
+    currentKernel() = static_cast<int>(kernel);
+    return true;
+}
+
+void rotationExtremes(const int *counts, size_t bits, uint64_t pattern
+    , int *maxCounts, int *minCounts)
+{
+    int hi[MAX_BITS], lo[MAX_BITS];
+    allExtremes(counts, bits, pattern, hi, lo);
+    for (size_t r = 0; r < bits; r++) {
+        maxCounts[r] = hi[r];
+        minCounts[r] = lo[r];
+    }
+}
+
+size_t lowestPeakRotation(const int *counts, size_t bits, uint64_t pattern)
+{
+    int hi[MAX_BITS], lo[MAX_BITS];
+    allExtremes(counts, bits, pattern, hi, lo);
+    size_t best = 0;
+    for (size_t r = 1; r < bits; r++) {
+        if (hi[r] <= hi[best]) { best = r; }
+    }
+    return best;
+}
+
+size_t bestRotation(const int *counts, size_t bits, uint64_t pattern)
+{
+    int hi[MAX_BITS], lo[MAX_BITS];
+    allExtremes(counts, bits, pattern, hi, lo);
+    size_t best = 0;
+    for (size_t r = 1; r < bits; r++) {
+        if (hi[r] < hi[best] || (hi[r] == hi[best] && lo[r] >= lo[best])) { best = r; }
+    }
+    return best;
+}
+
+NearestPattern nearestPattern(const uint64_t *patterns, size_t count, uint64_t window)
+{
+    NearestKernel kernel = nearestScalar;
+    switch (currentKernel().load(std::memory_order_relaxed)) {
+#if defined(LED_ROTATIONS_X86)
+    case ROTATION_KERNEL_SSE41: kernel = nearestSSE41; break;
+    case ROTATION_KERNEL_AVX2: kernel = nearestAVX2; break;
+#endif
+    default: break;
+    }
+    return kernel(patterns, count, window);
+}
@@ -0,0 +1,60 @@
+// Column sums for every rotation of a row at once.  Placing a row means
+// trying each of its rotations against the column histogram of the
+// other rows; rotationExtremes() finds the largest and smallest column
+// sum for all of them in one pass, using SSE4.1 or AVX2 when the
+// processor has them and plain C++ otherwise.  nearestPattern() matches
+// an observed window against the rotations of every row in the same
+// way.  The implementation is chosen the first time it is needed.
+
+#ifndef LED_ROTATIONS_H
+#define LED_ROTATIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum RotationKernel {
+    ROTATION_KERNEL_SCALAR = 0,     // Portable C++
+    ROTATION_KERNEL_SSE41,          // Four rotations at a time
+    ROTATION_KERNEL_AVX2            // Eight rotations at a time
+};
+
+// True if this build and processor can run the implementation.
+bool rotationKernelSupported(RotationKernel kernel);
+
+// The implementation in use, and its name for reports.
+RotationKernel rotationKernel();
+const char *rotationKernelName(RotationKernel kernel);
+
+// Use another implementation, as the benchmarks and tests do to compare
+// them.  Returns false, changing nothing, if it is not supported.  Do
+// not call it while tables are being solved on other threads.
+bool setRotationKernel(RotationKernel kernel);
+
+// For each rotation r from 0 to bits - 1, the largest and smallest
+// entries of counts[col] + (field col of the pattern rotated left by r)
+// over the columns.  'counts' has 'bits' entries, from 1 to 64, and the
+// outputs have room for 'bits' entries.
+void rotationExtremes(const int *counts, size_t bits, uint64_t pattern
+    , int *maxCounts, int *minCounts);
+
+// The rotation that gives the smallest largest column sum, preferring
+// larger rotations on ties, as greedyOptimumStride() places rows.
+size_t lowestPeakRotation(const int *counts, size_t bits, uint64_t pattern);
+
+// The rotation that gives the smallest largest column sum and, among
+// those, the largest smallest column sum, preferring larger rotations
+// on ties, as greedyReduceOverlaps() places rows.
+size_t bestRotation(const int *counts, size_t bits, uint64_t pattern);
+
+// Result of nearestPattern().
+struct NearestPattern
+{
+    int distance;                   // Smallest Hamming distance to the window, or 65 if there are no patterns
+    size_t count;                   // How many patterns are that close
+    size_t index;                   // The first of them
+};
+
+// Compare 'window' with each of 'count' patterns and find the closest.
+NearestPattern nearestPattern(const uint64_t *patterns, size_t count, uint64_t window);
+
+#endif
@@ -0,0 +1,130 @@
+#include "LED_simulator.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+namespace {
+
+    // Trials of one row drawn from each generator.
+    const unsigned long long BLOCK_TRIALS = 16384;
+
+    // Watch a row for one window of frames starting at a random phase.
+    // Returns the window seen through the noise, and sets 'clean' to the
+    // window that would have been seen without it.
+    Pattern observeWindow(Pattern row, size_t bits, const NoiseModel &noise
+        , SplitMix64 &rng, Pattern &clean)
+    {
+        size_t start = rng.below(bits);
+        clean = rotatePattern(row, start, bits);
+
+        // Each frame moves back by at most one field, so starting a
+        // whole row later keeps the position from wrapping below zero.
+        size_t field = start + bits;
+        Pattern window = 0;
+        for (size_t frame = 0; frame < bits; frame++, field++) {
+            if (noise.drop > 0 && rng.uniform() < noise.drop) { field++; }
+            if (noise.slip > 0 && rng.uniform() < noise.slip) {
+                field = (rng.next() & 1) ? field + 1 : field - 1;
+            }
+            Pattern seen = static_cast<Pattern>(patternField(row, field % bits, bits));
+            if (noise.flip > 0 && rng.uniform() < noise.flip) { seen ^= 1; }
+            window = (window << 1) | seen;
+        }
+        return window;
+    }
+
+    // Decode a window as the row that owns its nearest rotation.
+    int decodeWindow(const std::vector<Pattern> &rotations, const std::vector<int> &owners
+        , Pattern window, int acceptDistance)
+    {
+        NearestPattern nearest = nearestPattern(rotations.data(), rotations.size(), window);
+        if (acceptDistance >= 0 && nearest.distance > acceptDistance) { return DECODE_UNKNOWN; }
+        int LED = owners[nearest.index];
+        if (nearest.count > 1) {
+            // The window is as close to several rotations; that is only
+            // ambiguous if they are rotations of different rows.
+            for (size_t i = 0; i < rotations.size(); i++) {
+                if (owners[i] != LED
+                    && static_cast<int>(patternWeight(rotations[i] ^ window)) == nearest.distance) {
+                    return DECODE_AMBIGUOUS;
+                }
+            }
+        }
+        return LED;
+    }
+
+} // namespace
+
+SimulationResult simulateDecoding(const PatternView &table, const NoiseModel &noise
+    , unsigned long long trials, int acceptDistance, uint64_t seed, unsigned threads)
+{
+    SimulationResult ret;
+    ret.trials = ret.noisy = ret.correct = ret.misidentified = ret.ambiguous = ret.rejected = 0;
+    size_t bits = table.bits();
+    size_t LEDs = table.size();
+    if (LEDs == 0 || trials == 0) { return ret; }
+
+    // The distinct rotations of every row, and the row each came from.
+    std::vector<Pattern> rotations;
+    std::vector<int> owners;
+    for (size_t row = 0; row < LEDs; row++) {
+        size_t period = patternPeriod(table[row], bits);
+        for (size_t r = 0; r < period; r++) {
+            rotations.push_back(rotatePattern(table[row], r, bits));
+            owners.push_back(static_cast<int>(row));
+        }
+    }
+
+    std::mutex resultMutex;
+    std::map<std::pair<int, int>, unsigned long long> confusions;
+    unsigned long long blocksPerLED = (trials + BLOCK_TRIALS - 1) / BLOCK_TRIALS;
+    parallelFor(static_cast<size_t>(LEDs * blocksPerLED), threads, [&](size_t b) {
+        int LED = static_cast<int>(b / blocksPerLED);
+        unsigned long long first = (b % blocksPerLED) * BLOCK_TRIALS;
+        unsigned long long count = std::min(BLOCK_TRIALS, trials - first);
+        SplitMix64 rng(seed ^ (0x9E6C63D0676A9A99ULL * (b + 1)));
+
+        SimulationResult block;
+        block.noisy = block.correct = block.misidentified = block.ambiguous = block.rejected = 0;
+        std::map<int, unsigned long long> wrong;
+        for (unsigned long long t = 0; t < count; t++) {
+            Pattern clean;
+            Pattern window = observeWindow(table[LED], bits, noise, rng, clean);
+            if (window != clean) { block.noisy++; }
+            int decoded = decodeWindow(rotations, owners, window, acceptDistance);
+            if (decoded == LED) {
+                block.correct++;
+                continue;
+            }
+            if (decoded >= 0) { block.misidentified++; }
+            else if (decoded == DECODE_AMBIGUOUS) { block.ambiguous++; }
+            else { block.rejected++; }
+            wrong[decoded]++;
+        }
+
+        std::lock_guard<std::mutex> lock(resultMutex);
+        ret.trials += count;
+        ret.noisy += block.noisy;
+        ret.correct += block.correct;
+        ret.misidentified += block.misidentified;
+        ret.ambiguous += block.ambiguous;
+        ret.rejected += block.rejected;
+        for (std::map<int, unsigned long long>::const_iterator it = wrong.begin(); it != wrong.end(); ++it) {
+            confusions[std::make_pair(LED, it->first)] += it->second;
+        }
+    });
+
+    // Most frequent first, then in order of LED.
+    for (std::map<std::pair<int, int>, unsigned long long>::const_iterator it = confusions.begin();
+        it != confusions.end(); ++it) {
+        Confusion c;
+        c.LED = it->first.first;
+        c.decodedAs = it->first.second;
+        c.count = it->second;
+        ret.confusions.push_back(c);
+    }
+    std::stable_sort(ret.confusions.begin(), ret.confusions.end()
+        , [](const Confusion &a, const Confusion &b) { return a.count > b.count; });
+    return ret;
+}
@@ -0,0 +1,62 @@
+// Monte Carlo estimate of how often the tracker misidentifies LEDs.
+// Each trial watches one LED of a shifted table for a window of 'bits'
+// camera frames, starting at a random phase, with camera noise applied,
+// then decodes the window as the LED with the closest rotation.  Counting
+// how the windows decode gives the error rates and shows which LEDs are
+// mistaken for which, before the table goes into firmware.
+
+#ifndef LED_SIMULATOR_H
+#define LED_SIMULATOR_H
+
+#include "LED_decoder.h"
+
+#include <vector>
+
+// Camera noise applied to each simulated window, as the chance of each
+// kind of error at each frame.
+struct NoiseModel
+{
+    NoiseModel() : flip(0), drop(0), slip(0) {}
+
+    double flip;                    // A field is misread, bright as dark or dark as bright
+    double drop;                    // The frame is dropped, so the window skips a field
+    double slip;                    // The LED's clock slips, so a field is seen twice or skipped
+};
+
+// How often windows from one LED decoded as another LED (or as
+// DECODE_AMBIGUOUS or DECODE_UNKNOWN).
+struct Confusion
+{
+    int LED;
+    int decodedAs;
+    unsigned long long count;
+};
+
+// Result of simulateDecoding().
+struct SimulationResult
+{
+    unsigned long long trials;          // Windows decoded
+    unsigned long long noisy;           // Windows the noise changed
+    unsigned long long correct;         // Decoded as the LED that was watched
+    unsigned long long misidentified;   // Decoded as another LED
+    unsigned long long ambiguous;       // As close to more than one LED
+    unsigned long long rejected;        // Farther than the accepted distance from every LED
+    std::vector<Confusion> confusions;  // Every (LED, decodedAs) pair that was not correct, most frequent first
+};
+
+// Watch each row of a shifted table in 'trials' windows with the noise
+// applied, and decode each window as the row with a rotation at the
+// smallest Hamming distance from it.  A window that is as close to
+// rotations of two rows is ambiguous, and one farther than
+// 'acceptDistance' from every rotation is rejected (-1 accepts any
+// distance; 0 accepts only windows that are exact rotations, as
+// PatternDecoder does).
+//   The trials are spread over 'threads' workers (0 means one per
+// core) in blocks that each draw from their own generator seeded from
+// 'seed' and the block number, so results do not depend on the number
+// of threads.  Windows are matched against every rotation at once with
+// nearestPattern().
+SimulationResult simulateDecoding(const PatternView &table, const NoiseModel &noise
+    , unsigned long long trials, int acceptDistance, uint64_t seed, unsigned threads = 0);
+
+#endif
@@ -0,0 +1,1394 @@
+#include "LED_solver.h"
+#include "LED_stats.h"
+
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+    // Shared state for the workers of exactMinimumPeak().
+    class ExactSearch
+    {
+    public:
+        ExactSearch(const PatternTable &table, unsigned long long maxNodes
+            , SolveProgress *progress)
+            : m_table(table)
+            , m_bits(table.bits())
+            , m_maxNodes(maxNodes)
+            , m_progress(progress)
+            , m_best(table)
+            , m_stop(false)
+            , m_aborted(false)
+            , m_nodes(0)
+        {
+            // Record each row's weight and period and how many 1's remain
+            // below each row, for the bounds.
+            size_t rows = table.size();
+            m_periods.resize(rows);
+            m_remainingOnes.assign(rows + 1, 0);
+            for (size_t i = rows; i-- > 0; ) {
+                m_periods[i] = patternPeriod(table[i], m_bits);
+                m_remainingOnes[i] = m_remainingOnes[i + 1] + patternWeight(table[i]);
+            }
+            std::vector<int> sums = columnSums(table);
+            m_bestPeak = *std::max_element(sums.begin(), sums.end());
+
+            // The first row is never rotated, because rotating every row by
+            // the same amount does not change the column sums.
+            ColumnHistogram first(m_bits);
+            first.add(table[0]);
+            m_globalBound = std::max(fillLowerBound(first.counts(), m_remainingOnes[1], rows - 1)
+                , peakLowerBound(table));
+            if (m_bestPeak <= m_globalBound) { m_stop = true; }
+        }
+
+        // A subtree to search: the rotations of rows 1 through
+        // rotations.size() are fixed.
+        typedef std::vector<size_t> Task;
+
+        // Split the top of the tree into at least 'count' subtrees, or as
+        // many as there are if it runs out of rows first.
+        std::vector<Task> split(size_t count) const
+        {
+            std::vector<Task> tasks(1);
+            size_t depth = 0;
+            while (tasks.size() < count && depth + 1 < m_table.size()) {
+                std::vector<Task> next;
+                size_t row = depth + 1;
+                for (size_t t = 0; t < tasks.size(); t++) {
+                    for (size_t r = 0; r < m_periods[row]; r++) {
+                        Task task = tasks[t];
+                        task.push_back(r);
+                        next.push_back(task);
+                    }
+                }
+                tasks.swap(next);
+                depth++;
+            }
+            return tasks;
+        }
+
+        // Exhaustively search one subtree, pruning against the best result
+        // found by any worker.
+        void run(const Task &task)
+        {
+            if (m_stop || outOfTime()) { return; }
+            PatternTable work(m_table);
+            ColumnHistogram sums(m_bits);
+            sums.add(work[0]);
+            for (size_t k = 0; k < task.size(); k++) {
+                work[k + 1] = rotatePattern(m_table[k + 1], task[k], m_bits);
+                sums.add(work[k + 1]);
+            }
+            unsigned long long nodes = 0;
+            search(work, sums, task.size() + 1, nodes);
+            m_nodes += nodes;
+        }
+
+        bool stopped() const { return m_stop; }
+
+        ExactSearchResult result(PatternTable &table) const
+        {
+            ExactSearchResult ret;
+            ret.peak = m_bestPeak;
+            ret.nodes = m_nodes;
+            ret.boundReached = (m_bestPeak <= m_globalBound);
+            // If we searched everything, nothing better than the best exists.
+            ret.lowerBound = m_aborted ? m_globalBound : m_bestPeak.load();
+            if (ret.boundReached) { ret.lowerBound = m_globalBound; }
+            ret.optimal = (ret.peak <= ret.lowerBound);
+            table = m_best;
+            return ret;
+        }
+
+    private:
+        // Depth-first search over the rotations of rows 'row' and below.
+        void search(PatternTable &work, ColumnHistogram &sums, size_t row
+            , unsigned long long &nodes)
+        {
+            if (m_stop) { return; }
+
+            // Account for our nodes in batches to avoid contention.
+            if (++nodes == 1024) {
+                unsigned long long total = (m_nodes += nodes);
+                nodes = 0;
+                if ((m_maxNodes != 0 && total >= m_maxNodes) || outOfTime()) {
+                    m_aborted = true;
+                    m_stop = true;
+                    return;
+                }
+            }
+
+            int best = m_bestPeak;
+            if (row == work.size()) {
+                int peak = *std::max_element(sums.counts().begin(), sums.counts().end());
+                if (peak < best) { record(work, peak); }
+                return;
+            }
+            if (fillLowerBound(sums.counts(), m_remainingOnes[row], work.size() - row) >= best) {
+                return;
+            }
+
+            // Try the rotations that keep the peak lowest first, so that
+            // good solutions are found early and prune more of the tree.
+            Pattern original = m_table[row];
+            int peaks[MAX_PATTERN_BITS], floors[MAX_PATTERN_BITS];
+            rotationExtremes(sums.counts().data(), m_bits, original, peaks, floors);
+            std::vector< std::pair<int, size_t> > candidates;
+            for (size_t r = 0; r < m_periods[row]; r++) {
+                if (peaks[r] < best) { candidates.push_back(std::make_pair(peaks[r], r)); }
+            }
+            std::sort(candidates.begin(), candidates.end());
+            for (size_t c = 0; c < candidates.size(); c++) {
+                if (candidates[c].first >= m_bestPeak) { break; }
+                work[row] = rotatePattern(original, candidates[c].second, m_bits);
+                sums.add(work[row]);
+                search(work, sums, row + 1, nodes);
+                sums.remove(work[row]);
+                if (m_stop) { break; }
+            }
+            work[row] = original;
+        }
+
+        // Stop the search if the time budget has run out.
+        bool outOfTime()
+        {
+            if (!m_progress || !m_progress->expired()) { return false; }
+            m_aborted = true;
+            m_stop = true;
+            return true;
+        }
+
+        // Record a new best layout.
+        void record(const PatternTable &work, int peak)
+        {
+            std::lock_guard<std::mutex> lock(m_bestMutex);
+            if (peak >= m_bestPeak) { return; }
+            m_best = work;
+            m_bestPeak = peak;
+            if (m_progress) { m_progress->record("exactMinimumPeak", peak); }
+            if (peak <= m_globalBound) { m_stop = true; }
+        }
+
+        const PatternTable &m_table;
+        size_t m_bits;
+        unsigned long long m_maxNodes;
+        SolveProgress *m_progress;
+        std::vector<size_t> m_periods;
+        std::vector<size_t> m_remainingOnes;
+        int m_globalBound;
+
+        std::mutex m_bestMutex;
+        PatternTable m_best;
+        std::atomic<int> m_bestPeak;
+        std::atomic<bool> m_stop;
+        std::atomic<bool> m_aborted;
+        std::atomic<unsigned long long> m_nodes;
+    };
+
+    // Per-thread queues of tasks.  Each worker takes tasks from the front
+    // of its own queue and, when that runs dry, steals from the back of
+    // another worker's queue.
+    template <class Task>
+    class WorkStealingQueues
+    {
+    public:
+        explicit WorkStealingQueues(size_t workers) : m_queues(workers), m_mutexes(workers) {}
+
+        void push(size_t worker, const Task &task)
+        {
+            std::lock_guard<std::mutex> lock(m_mutexes[worker]);
+            m_queues[worker].push_back(task);
+        }
+
+        bool pop(size_t worker, Task &task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutexes[worker]);
+                if (!m_queues[worker].empty()) {
+                    task = m_queues[worker].front();
+                    m_queues[worker].pop_front();
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < m_queues.size(); i++) {
+                size_t victim = (worker + i) % m_queues.size();
+                std::lock_guard<std::mutex> lock(m_mutexes[victim]);
+                if (!m_queues[victim].empty()) {
+                    task = m_queues[victim].back();
+                    m_queues[victim].pop_back();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        std::vector< std::deque<Task> > m_queues;
+        std::vector<std::mutex> m_mutexes;
+    };
+
+    // Score a histogram for annealing: the maximum column sum dominates,
+    // and among equal maxima fewer columns at the maximum is better.
+    long annealEnergy(const std::vector<int> &counts)
+    {
+        int peak = counts[0];
+        long atPeak = 0;
+        for (size_t col = 0; col < counts.size(); col++) {
+            if (counts[col] > peak) {
+                peak = counts[col];
+                atPeak = 0;
+            }
+            if (counts[col] == peak) { atPeak++; }
+        }
+        return peak * static_cast<long>(counts.size() + 1) + atPeak;
+    }
+
+    // Smallest Hamming distance between 'b' and the precomputed
+    // rotations of another pattern, stopping early once it reaches
+    // 'floor', which no rotation can beat.
+    int rotationsDistance(const Pattern *rotations, size_t bits, Pattern b, int floor)
+    {
+        int best = static_cast<int>(bits);
+        for (size_t r = 0; r < bits; r++) {
+            int d = static_cast<int>(patternWeight(rotations[r] ^ b));
+            if (d < best) {
+                best = d;
+                if (best <= floor) { break; }
+            }
+        }
+        return best;
+    }
+
+    // Record a distance in a running (nearest, count at nearest) pair.
+    void noteDistance(int d, int &nearest, size_t &atNearest)
+    {
+        if (d < nearest) {
+            nearest = d;
+            atNearest = 1;
+        }
+        else if (d == nearest) {
+            atNearest++;
+        }
+    }
+
+    // Fill rows from 'start' to the end of 'table' with the candidates
+    // farthest from the rows already chosen, one at a time, as described
+    // for greedyEncodeInto().  The chosen rows are left in candidate
+    // order.
+    void selectDistantPatterns(PatternTable &table, size_t start
+        , const PatternTable &candidates, unsigned threads)
+    {
+        size_t bits = table.bits();
+        size_t count = candidates.size();
+        size_t needed = table.size() - start;
+        int weight = static_cast<int>(patternWeight(candidates[0]));
+
+        // Each candidate's rotations, and its distance to the nearest
+        // row chosen so far and how many rows are that near.
+        std::vector<Pattern> rotations(count * bits);
+        std::vector<int> nearest(count, static_cast<int>(bits) + 1);
+        std::vector<size_t> atNearest(count, 0);
+        std::vector<char> used(count, 0);
+        parallelFor(count, threads, [&](size_t c) {
+            Pattern *rot = &rotations[c * bits];
+            for (size_t r = 0; r < bits; r++) {
+                rot[r] = rotatePattern(candidates[c], r, bits);
+            }
+            for (size_t row = 0; row < start; row++) {
+                int floor = abs(weight - static_cast<int>(patternWeight(table[row])));
+                noteDistance(rotationsDistance(rot, bits, table[row], floor)
+                    , nearest[c], atNearest[c]);
+            }
+        });
+
+        // Threads only pay for themselves on large candidate sets.
+        unsigned updateThreads = (count * bits >= 65536) ? threads : 1;
+        std::vector<size_t> chosen;
+        for (size_t k = 0; k < needed; k++) {
+            size_t best = count;
+            for (size_t c = 0; c < count; c++) {
+                if (used[c]) { continue; }
+                if (best == count || nearest[c] > nearest[best]
+                    || (nearest[c] == nearest[best] && atNearest[c] < atNearest[best])) {
+                    best = c;
+                }
+            }
+            used[best] = 1;
+            chosen.push_back(best);
+            if (k + 1 == needed) { break; }
+            Pattern picked = candidates[best];
+            parallelFor(count, updateThreads, [&](size_t c) {
+                if (!used[c]) {
+                    noteDistance(rotationsDistance(&rotations[c * bits], bits, picked, 0)
+                        , nearest[c], atNearest[c]);
+                }
+            });
+        }
+        std::sort(chosen.begin(), chosen.end());
+        for (size_t k = 0; k < needed; k++) {
+            table[start + k] = candidates[chosen[k]];
+        }
+    }
+
+} // namespace
+
+bool hasOddParity(unsigned int n)
+{
+    return (patternWeight(n) & 1) != 0;
+}
+
+size_t encodedPatternBits(size_t bits)
+{
+    return 2 * bits + 6;
+}
+
+Pattern encodePattern(unsigned int ID, size_t bits)
+{
+    Pattern ret = 0;
+
+    // If we don't have enough bits to encode, return empty.
+    if (bits >= 32 || encodedPatternBits(bits) > MAX_PATTERN_BITS) { return ret; }
+    if (ID >= (static_cast<unsigned int>(1) << bits)) { return ret; }
+
+    // Encode the start-of-frame marker
+    ret = (ret << 1) | 1;
+    ret = (ret << 1) | 1;
+
+    // Encode the parity bit.
+    ret = (ret << 1) | 0;
+    ret = (ret << 1) | (hasOddParity(ID) ? 1 : 0);
+
+    // Encode the data bits, MSB first.
+    for (unsigned int myBit = (1 << (bits - 1) ); myBit > 0; myBit >>= 1) {
+        ret = (ret << 1) | 0;
+        ret = (ret << 1) | (((ID & myBit) != 0) ? 1 : 0);
+    }
+
+    // Encode the stop bit
+    ret = (ret << 1) | 0;
+    ret = (ret << 1) | 0;
+
+    return ret;
+}
+
+Pattern canonicalRotation(Pattern p, size_t bits)
+{
+    Pattern best = p;
+    for (size_t r = 1; r < bits; r++) {
+        Pattern rotated = rotatePattern(p, r, bits);
+        if (rotated > best) { best = rotated; }
+    }
+    return best;
+}
+
+size_t patternPeriod(Pattern p, size_t bits)
+{
+    for (size_t r = 1; r < bits; r++) {
+        if (bits % r == 0 && rotatePattern(p, r, bits) == p) { return r; }
+    }
+    return bits;
+}
+
+PatternTable constructRotationallyInvariant(size_t ones, size_t bits, size_t maxPatterns)
+{
+    PatternTable ret(bits);
+    AppendToTable append(ret, maxPatterns);
+    enumerateNecklaces(ones, bits, append);
+    LED_STATS_COUNT(candidatesEnumerated, ret.size());
+    return ret;
+}
+
+std::shared_ptr<const PatternTable> NecklaceCache::patterns(size_t ones, size_t bits, size_t count)
+{
+    std::pair<size_t, size_t> key(ones, bits);
+    size_t build = count;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::map<std::pair<size_t, size_t>, Entry>::const_iterator found = m_entries.find(key);
+        if (found != m_entries.end()) {
+            const Entry &entry = found->second;
+            if (entry.all || (count != 0 && entry.patterns->size() >= count)) {
+                return entry.patterns;
+            }
+            if (count != 0) { build = std::max(count, 2 * entry.patterns->size()); }
+        }
+    }
+
+    // Enumerate without holding the lock; if another thread built the
+    // same patterns meanwhile, keep the longer list.
+    std::shared_ptr<const PatternTable> built = std::make_shared<const PatternTable>(
+        constructRotationallyInvariant(ones, bits, build));
+    bool all = (build == 0) || (built->size() < build);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry &entry = m_entries[key];
+    if (!entry.patterns || entry.patterns->size() < built->size()) {
+        entry.patterns = built;
+        entry.all = all;
+    }
+    return entry.patterns;
+}
+
+void NecklaceCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+}
+
+void greedyEncodeInto(PatternTable &ret, size_t LEDs, size_t bits, unsigned parity
+    , bool maximizeDistance, unsigned threads, NecklaceCache *cache)
+{
+    ScopedPhase phase("encode");
+    ret.reset(bits);
+    if (LEDs == 0 || bits > MAX_PATTERN_BITS) { return; }
+    ret.reserve(LEDs);
+
+    for (size_t b = 1; b <= bits; b++) {
+        // Make sure our parity matches that specified
+        if ( ((parity == 1) && (b % 2 != 1)) ||
+             ((parity == 2) && (b % 2 != 0)) ) {
+            continue;
+        }
+
+        // Add all of the b-bit patterns that are not rotationally
+        // symmetric with one another to the list.  If we fill up all
+        // the ones we need, return.
+        size_t start = ret.size();
+        size_t needed = LEDs - start;
+        if (cache) {
+            std::shared_ptr<const PatternTable> patterns = cache->patterns(b, bits, needed);
+            size_t count = std::min(needed, patterns->size());
+            for (size_t i = 0; i < count; i++) { ret.push_back((*patterns)[i]); }
+        }
+        else {
+            AppendToTable append(ret, LEDs);
+            enumerateNecklaces(b, bits, append);
+            LED_STATS_COUNT(candidatesEnumerated, ret.size() - start);
+        }
+        if (ret.size() == LEDs) {
+            if (maximizeDistance) {
+                // Choose the last rows from a larger pool of b-bit patterns.
+                size_t pool = std::max(MAX_DISTANCE_CANDIDATES, 4 * needed);
+                PatternTable candidates(bits);
+                if (cache) {
+                    std::shared_ptr<const PatternTable> patterns = cache->patterns(b, bits, pool);
+                    size_t count = std::min(pool, patterns->size());
+                    for (size_t i = 0; i < count; i++) { candidates.push_back((*patterns)[i]); }
+                }
+                else {
+                    AppendToTable candidate(candidates, pool);
+                    enumerateNecklaces(b, bits, candidate);
+                    LED_STATS_COUNT(candidatesEnumerated, candidates.size());
+                }
+                if (candidates.size() > needed) {
+                    selectDistantPatterns(ret, start, candidates, threads);
+                }
+            }
+            return;
+        }
+    }
+}
+
+PatternTable greedyEncodeUpTo(size_t LEDs, size_t bits, unsigned parity
+    , bool maximizeDistance, unsigned threads)
+{
+    PatternTable ret;
+    greedyEncodeInto(ret, LEDs, bits, parity, maximizeDistance, threads);
+    return ret;
+}
+
+PatternTable greedyOptimalEncode(size_t LEDs, size_t bits, unsigned parity
+    , bool maximizeDistance, unsigned threads)
+{
+    PatternTable ret = greedyEncodeUpTo(LEDs, bits, parity, maximizeDistance, threads);
+
+    // We cannot succeed because we don't have enough bits, so return an empty
+    // result.
+    if (ret.size() < LEDs) { ret.clear(); }
+    return ret;
+}
+
+void simpleEncodeInto(PatternTable &ret, size_t LEDs, size_t bits)
+{
+    ScopedPhase phase("encode");
+    ret.reset(encodedPatternBits(bits));
+    for (unsigned i = 0; i < LEDs; i++) {
+        Pattern p = encodePattern(i, bits);
+        if (p == 0) { break; }
+        ret.push_back(p);
+    }
+    LED_STATS_COUNT(candidatesEnumerated, ret.size());
+}
+
+PatternTable simpleEncodeUpTo(size_t LEDs, size_t bits)
+{
+    PatternTable ret;
+    simpleEncodeInto(ret, LEDs, bits);
+    return ret;
+}
+
+namespace {
+
+    // Binomial coefficients C(n, k) for n up to MAX_PATTERN_BITS, all
+    // of which fit in 64 bits.
+    class BinomialTable
+    {
+    public:
+        BinomialTable()
+        {
+            for (size_t n = 0; n <= MAX_PATTERN_BITS; n++) {
+                m_values[n][0] = 1;
+                for (size_t k = 1; k <= n; k++) {
+                    m_values[n][k] = m_values[n - 1][k - 1] + ((k < n) ? m_values[n - 1][k] : 0);
+                }
+            }
+        }
+        uint64_t operator()(size_t n, size_t k) const { return m_values[n][k]; }
+
+    private:
+        uint64_t m_values[MAX_PATTERN_BITS + 1][MAX_PATTERN_BITS + 1];
+    };
+
+    // Euler's totient.
+    uint64_t totient(size_t n)
+    {
+        uint64_t ret = n;
+        for (size_t p = 2; p * p <= n; p++) {
+            if (n % p != 0) { continue; }
+            while (n % p == 0) { n /= p; }
+            ret -= ret / p;
+        }
+        if (n > 1) { ret -= ret / n; }
+        return ret;
+    }
+
+    bool weightAllowed(size_t ones, unsigned parity)
+    {
+        return !((parity == 1 && ones % 2 != 1) || (parity == 2 && ones % 2 != 0));
+    }
+
+    // Largest number of data bits encodePattern() accepts.
+    size_t maxSimpleEncodingBits()
+    {
+        size_t bits = 0;
+        while (bits + 1 < 32 && encodedPatternBits(bits + 1) <= MAX_PATTERN_BITS) { bits++; }
+        return bits;
+    }
+
+} // namespace
+
+uint64_t necklaceCount(size_t ones, size_t bits)
+{
+    if (bits == 0 || bits > MAX_PATTERN_BITS || ones > bits) { return 0; }
+    static const BinomialTable binomial;
+    uint64_t sum = 0;
+    for (size_t d = 1; d <= bits; d++) {
+        if (bits % d == 0 && ones % d == 0) {
+            sum += totient(d) * binomial(bits / d, ones / d);
+        }
+    }
+    return sum / bits;
+}
+
+uint64_t encodingCapacity(size_t bits, unsigned parity, bool simple_encoding)
+{
+    if (simple_encoding) {
+        if (bits == 0 || bits > maxSimpleEncodingBits()) { return 0; }
+        return static_cast<uint64_t>(1) << bits;
+    }
+    // Every weight but 0, which greedyEncodeInto() never uses.
+    uint64_t ret = 0;
+    for (size_t ones = 1; ones <= bits; ones++) {
+        if (weightAllowed(ones, parity)) { ret += necklaceCount(ones, bits); }
+    }
+    return ret;
+}
+
+size_t minimumEncodingBits(size_t LEDs, unsigned parity, bool simple_encoding)
+{
+    for (size_t bits = 1; bits <= MAX_PATTERN_BITS; bits++) {
+        if (encodingCapacity(bits, parity, simple_encoding) >= LEDs) { return bits; }
+    }
+    return 0;
+}
+
+uint64_t encodingWeight(size_t LEDs, size_t bits, unsigned parity, bool simple_encoding)
+{
+    if (LEDs > encodingCapacity(bits, parity, simple_encoding)) { return 0; }
+    uint64_t ret = 0;
+    if (simple_encoding) {
+        // Two start-of-frame 1's, a parity field that is 1 for half of
+        // each even-odd pair of IDs, and the 1 bits of the IDs, counted
+        // a bit position at a time.
+        uint64_t n = LEDs;
+        ret = 2 * n + n / 2;
+        if (n % 2 == 1 && hasOddParity(static_cast<unsigned>(n - 1))) { ret++; }
+        for (size_t b = 0; b < bits; b++) {
+            uint64_t period = static_cast<uint64_t>(2) << b;
+            uint64_t half = period / 2;
+            ret += (n / period) * half + ((n % period > half) ? n % period - half : 0);
+        }
+        return ret;
+    }
+    uint64_t remaining = LEDs;
+    for (size_t ones = 1; ones <= bits && remaining > 0; ones++) {
+        if (!weightAllowed(ones, parity)) { continue; }
+        uint64_t count = std::min(remaining, necklaceCount(ones, bits));
+        ret += count * ones;
+        remaining -= count;
+    }
+    return ret;
+}
+
+void columnSums(const PatternView &table, std::vector<int> &ret, size_t nRows)
+{
+    LED_STATS_COUNT(columnSumsComputed, 1);
+    size_t rowLength = table.bits();
+    ret.assign(rowLength, 0);
+    if (nRows == 0) { nRows = table.size(); }
+    for (size_t row = 0; row < nRows; row++) {
+        Pattern p = table[row];
+        for (size_t col = 0; col < rowLength; col++) {
+            ret[col] += patternField(p, col, rowLength);
+        }
+    }
+}
+
+std::vector<int> columnSums(const PatternView &table, size_t nRows)
+{
+    std::vector<int> ret;
+    columnSums(table, ret, nRows);
+    return ret;
+}
+
+SolveProgress::SolveProgress(double budget)
+    : m_interrupted(false)
+{
+    restart(budget);
+}
+
+void SolveProgress::restart(double budget)
+{
+    m_start = std::chrono::steady_clock::now();
+    m_budget = (budget > 0) ? budget : 0;
+    m_deadline = m_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(m_budget));
+    m_interrupted = false;
+    m_trajectory.clear();
+}
+
+double SolveProgress::elapsed() const
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+bool SolveProgress::expired() const
+{
+    if (m_budget == 0) { return false; }
+    if (m_interrupted) { return true; }
+    if (std::chrono::steady_clock::now() < m_deadline) { return false; }
+    m_interrupted = true;
+    return true;
+}
+
+void SolveProgress::record(const char *phase, int peak)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_trajectory.empty() && peak >= m_trajectory.back().peak) { return; }
+    TrajectoryPoint point;
+    point.seconds = elapsed();
+    point.peak = peak;
+    point.phase = phase;
+    m_trajectory.push_back(point);
+}
+
+void SolveProgress::trajectory(std::vector<TrajectoryPoint> &points) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    points.assign(m_trajectory.begin(), m_trajectory.end());
+}
+
+void applyFixedStride(int stride, PatternTable &table)
+{
+    if (table.size() == 0) { return; }
+
+    size_t rowLength = table.bits();
+    for (size_t i = 1; i < table.size(); i++) {
+        size_t newFirst = (i * stride) % rowLength;
+        newFirst = rowLength - newFirst;
+        table[i] = rotatePattern(table[i], newFirst, rowLength);
+    }
+}
+
+void greedyOptimumStride(PatternTable &table, ColumnHistogram &above
+    , SolveProgress *progress)
+{
+    if (table.size() == 0) { return; }
+
+    // Leave the first row un-rotated.
+    // For the following rows, pick the least-rotated choice
+    // with the minimal overlap with previous rows.
+    size_t rowLength = table.bits();
+    above.reset(rowLength);
+    above.add(table[0]);
+    size_t i = 1;
+    for (; i < table.size(); i++) {
+        if (progress && progress->expired()) { break; }
+
+        // Find the maximum rotation that has the lowest overlap count,
+        // trying all of them at once.
+        Pattern original = table[i];
+        size_t minRotation = above.lowestPeakRotation(original);
+
+        // Rotate by the best amount to reach minimum.
+        table[i] = rotatePattern(original, minRotation, rowLength);
+        above.add(table[i]);
+    }
+    LED_STATS_COUNT(rotationChecks, (i - 1) * rowLength);
+}
+
+void greedyOptimumStride(PatternTable &table)
+{
+    ColumnHistogram scratch;
+    greedyOptimumStride(table, scratch);
+}
+
+size_t greedyReduceOverlaps(PatternTable &table, ColumnHistogram &sums
+    , SolveProgress *progress)
+{
+    if (table.size() == 0) { return 0; }
+
+    size_t improved = 0;
+    size_t rowLength = table.bits();
+    sums.assign(table);
+    size_t i = 0;
+    for (; i < table.size(); i++) {
+        if (progress && progress->expired()) { break; }
+
+        // Take this row out of the histogram, then find the maximum
+        // rotation that has the lowest maximum overlap count and,
+        // within that, the largest minimum overlap count.
+        Pattern original = table[i];
+        sums.remove(original);
+        size_t minRotation = sums.bestRotation(original);
+
+        // Rotate by the best amount to reach minimum.
+        table[i] = rotatePattern(original, minRotation, rowLength);
+        sums.add(table[i]);
+        if (minRotation != 0) { improved++; }
+    }
+    LED_STATS_COUNT(rotationChecks, i * rowLength);
+    return improved;
+}
+
+size_t greedyReduceOverlaps(PatternTable &table)
+{
+    ColumnHistogram scratch;
+    return greedyReduceOverlaps(table, scratch);
+}
+
+namespace {
+
+    // Identifies a layout of a table, for spotting repeats.
+    uint64_t layoutHash(const PatternTable &table)
+    {
+        SplitMix64 mix(table.size());
+        uint64_t hash = mix.next();
+        for (size_t i = 0; i < table.size(); i++) {
+            mix = SplitMix64(hash ^ table[i]);
+            hash = mix.next();
+        }
+        return hash;
+    }
+
+    int histogramPeak(const ColumnHistogram &sums)
+    {
+        return *std::max_element(sums.counts().begin(), sums.counts().end());
+    }
+
+    // Run up to 'passes' passes of greedyReduceOverlaps(), stopping early
+    // as described for shiftTable().
+    void reduceOverlaps(PatternTable &table, unsigned passes, ColumnHistogram &scratch
+        , SolveProgress *progress, OverlapScratch *overlaps)
+    {
+        if (passes == 0 || table.size() == 0) { return; }
+        OverlapScratch local;
+        if (!overlaps) { overlaps = &local; }
+        int bound = peakLowerBound(table, overlaps->bound);
+        scratch.assign(table);
+        std::vector<uint64_t> &layouts = overlaps->layouts;
+        layouts.assign(1, layoutHash(table));
+        for (unsigned i = 0; i < passes; i++) {
+            if (histogramPeak(scratch) <= bound) { return; }
+            if (progress && progress->expired()) { return; }
+
+            ScopedPhase phase("greedyReduceOverlaps", static_cast<int>(i));
+            size_t rotated = greedyReduceOverlaps(table, scratch, progress);
+            phase.setAccepted(rotated);
+            if (progress) { progress->record("greedyReduceOverlaps", histogramPeak(scratch)); }
+            if (rotated == 0) { return; }
+            uint64_t layout = layoutHash(table);
+            if (std::find(layouts.begin(), layouts.end(), layout) != layouts.end()) { return; }
+            layouts.push_back(layout);
+        }
+    }
+
+} // namespace
+
+void shiftTable(PatternTable &table, int stride, unsigned stride_optimizations
+    , ColumnHistogram &scratch, SolveProgress *progress, OverlapScratch *overlaps)
+{
+    // Reverse the order of the elements to put the ones with the most
+    // bits first.  This will mean that we pack the hardest ones first
+    // and have a better chance of "filling in" loose slots later,
+    // producing a more compact packing.
+    std::reverse(table.begin(), table.end());
+
+    // Shift the encodings based on the requested stride between elements.
+    if (stride >= 0) {
+        ScopedPhase phase("applyFixedStride");
+        applyFixedStride(stride, table);
+    }
+    else {
+        ScopedPhase phase("greedyOptimumStride");
+        greedyOptimumStride(table, scratch, progress);
+    }
+    if (progress && table.size() > 0) {
+        scratch.assign(table);
+        progress->record((stride >= 0) ? "applyFixedStride" : "greedyOptimumStride"
+            , histogramPeak(scratch));
+    }
+
+    // Try to find better strides by shifting each row by the maximum
+    // stride that doesn't make things worse.
+    reduceOverlaps(table, stride_optimizations, scratch, progress, overlaps);
+}
+
+void shiftTable(PatternTable &table, int stride, unsigned stride_optimizations)
+{
+    ColumnHistogram scratch;
+    shiftTable(table, stride, stride_optimizations, scratch);
+}
+
+WarmStartResult warmStartTable(const PatternView &previous, const PatternTable &unshifted
+    , PatternTable &table, unsigned passes, ColumnHistogram &scratch
+    , SolveProgress *progress, OverlapScratch *overlaps)
+{
+    WarmStartResult ret;
+    ret.kept = ret.placed = 0;
+    size_t LEDs = unshifted.size();
+    size_t bits = unshifted.bits();
+    ret.dropped = (previous.size() > LEDs) ? previous.size() - LEDs : 0;
+
+    // Look the new patterns up by canonical rotation.  They are taken
+    // heaviest first, as shiftTable() places them, so index them in
+    // reverse order.
+    std::vector<std::pair<Pattern, size_t> > byRotation(LEDs);
+    for (size_t i = 0; i < LEDs; i++) {
+        size_t source = LEDs - 1 - i;
+        byRotation[i] = std::make_pair(canonicalRotation(unshifted[source], bits), i);
+    }
+    std::sort(byRotation.begin(), byRotation.end());
+    std::vector<char> used(LEDs, 0);
+
+    // Keep the rows whose patterns are still in use.
+    table.reset(bits);
+    table.resize(LEDs);
+    std::vector<char> kept(LEDs, 0);
+    if (previous.bits() == bits) {
+        for (size_t row = 0; row < LEDs && row < previous.size(); row++) {
+            Pattern canonical = canonicalRotation(previous[row], bits);
+            std::vector<std::pair<Pattern, size_t> >::iterator it = std::lower_bound(
+                byRotation.begin(), byRotation.end(), std::make_pair(canonical, static_cast<size_t>(0)));
+            for (; it != byRotation.end() && it->first == canonical; ++it) {
+                if (!used[it->second]) {
+                    used[it->second] = 1;
+                    kept[row] = 1;
+                    table[row] = previous[row];
+                    ret.kept++;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Give the leftover patterns to the other rows in order, placing
+    // each against the histogram of everything placed so far.
+    scratch.reset(bits);
+    for (size_t row = 0; row < LEDs; row++) {
+        if (kept[row]) { scratch.add(table[row]); }
+    }
+    size_t next = 0;
+    for (size_t row = 0; row < LEDs; row++) {
+        if (kept[row]) { continue; }
+        while (used[next]) { next++; }
+        used[next] = 1;
+        Pattern p = unshifted[LEDs - 1 - next];
+        table[row] = rotatePattern(p, scratch.bestRotation(p), bits);
+        scratch.add(table[row]);
+        ret.placed++;
+    }
+    LED_STATS_COUNT(rotationChecks, ret.placed * bits);
+    if (progress && LEDs > 0) { progress->record("warmStartTable", histogramPeak(scratch)); }
+
+    reduceOverlaps(table, passes, scratch, progress, overlaps);
+    return ret;
+}
+
+int theoreticalMinimum(const std::vector<int> &sums, size_t bits)
+{
+    int numOnes = 0;
+    for (size_t i = 0; i < sums.size(); i++) {
+        numOnes += sums[i];
+    }
+    int minOnes = numOnes / bits;
+    if (numOnes % bits != 0) {
+        minOnes++;
+    }
+    return minOnes;
+}
+
+int peakLowerBound(const PatternView &table, LowerBoundScratch &scratch)
+{
+    size_t bits = table.bits();
+    if (table.size() == 0 || bits == 0) { return 0; }
+    uint64_t ones = 0;
+    for (size_t i = 0; i < table.size(); i++) { ones += patternWeight(table[i]); }
+    int bound = static_cast<int>((ones + bits - 1) / bits);
+    if (bits % 2 != 0) { return bound; }
+
+    // Each row puts a of its 1's in the even columns and b in the odd
+    // ones, or the other way round.  Count the 1's in the even columns
+    // with every row the lighter way round, then find the sums of the
+    // differences that the rows swapped the other way can add.
+    Pattern evenColumns = static_cast<Pattern>(0xAAAAAAAAAAAAAAAAULL) & patternMask(bits);
+    uint64_t even = 0;
+    std::vector<size_t> &differences = scratch.differences;
+    differences.clear();
+    size_t totalDifference = 0;
+    for (size_t i = 0; i < table.size(); i++) {
+        size_t a = patternWeight(table[i] & evenColumns);
+        size_t b = patternWeight(table[i]) - a;
+        even += std::min(a, b);
+        if (a != b) {
+            differences.push_back((a > b) ? a - b : b - a);
+            totalDifference += differences.back();
+        }
+    }
+    std::vector<uint64_t> &reachable = scratch.reachable;
+    reachable.assign(totalDifference / 64 + 1, 0);
+    reachable[0] = 1;
+    for (size_t d = 0; d < differences.size(); d++) {
+        size_t words = differences[d] / 64;
+        size_t shift = differences[d] % 64;
+        for (size_t w = reachable.size(); w-- > words; ) {
+            uint64_t moved = reachable[w - words] << shift;
+            if (shift != 0 && w > words) { moved |= reachable[w - words - 1] >> (64 - shift); }
+            reachable[w] |= moved;
+        }
+    }
+
+    // The fuller half holds at least as many 1's as the most even
+    // reachable split, and it has bits / 2 columns.
+    uint64_t fuller = ones;
+    for (size_t s = 0; s <= totalDifference; s++) {
+        if ((reachable[s / 64] >> (s % 64)) & 1) {
+            uint64_t half = even + s;
+            fuller = std::min(fuller, std::max(half, ones - half));
+        }
+    }
+    size_t halfColumns = bits / 2;
+    return std::max(bound, static_cast<int>((fuller + halfColumns - 1) / halfColumns));
+}
+
+int peakLowerBound(const PatternView &table)
+{
+    LowerBoundScratch scratch;
+    return peakLowerBound(table, scratch);
+}
+
+PairDistance minimumRotationalDistance(const PatternView &table, unsigned threads)
+{
+    PairDistance ret;
+    ret.distance = -1;
+    ret.first = ret.second = 0;
+    ret.pairs = 0;
+    size_t rows = table.size();
+    size_t bits = table.bits();
+    if (rows < 2) { return ret; }
+
+    // Each row finds its nearest row after it, skipping rows whose
+    // difference in weight alone puts them farther than that.
+    std::vector<int> nearest(rows, static_cast<int>(bits) + 1);
+    std::vector<size_t> partner(rows, 0), atNearest(rows, 0);
+    parallelFor(rows - 1, threads, [&](size_t i) {
+        Pattern rotations[MAX_PATTERN_BITS];
+        for (size_t r = 0; r < bits; r++) {
+            rotations[r] = rotatePattern(table[i], r, bits);
+        }
+        int weight = static_cast<int>(patternWeight(table[i]));
+        for (size_t j = i + 1; j < rows; j++) {
+            int floor = abs(weight - static_cast<int>(patternWeight(table[j])));
+            if (floor > nearest[i]) { continue; }
+            int d = rotationsDistance(rotations, bits, table[j], floor);
+            if (d < nearest[i]) { partner[i] = j; }
+            noteDistance(d, nearest[i], atNearest[i]);
+        }
+    });
+
+    for (size_t i = 0; i + 1 < rows; i++) {
+        if (ret.distance < 0 || nearest[i] < ret.distance) {
+            ret.distance = nearest[i];
+            ret.first = i;
+            ret.second = partner[i];
+            ret.pairs = atNearest[i];
+        }
+        else if (nearest[i] == ret.distance) {
+            ret.pairs += atNearest[i];
+        }
+    }
+    return ret;
+}
+
+int fillLowerBound(const std::vector<int> &counts, size_t remainingOnes, size_t remainingRows)
+{
+    int level = *std::max_element(counts.begin(), counts.end());
+    for (;;) {
+        size_t room = 0;
+        for (size_t col = 0; col < counts.size(); col++) {
+            if (counts[col] < level) {
+                room += std::min(static_cast<size_t>(level - counts[col]), remainingRows);
+            }
+        }
+        if (room >= remainingOnes) { return level; }
+        level++;
+    }
+}
+
+unsigned defaultThreadCount()
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    return (threads == 0) ? 1 : threads;
+}
+
+ExactSearchResult exactMinimumPeak(PatternTable &table, unsigned long long maxNodes
+    , unsigned threads, SolveProgress *progress)
+{
+    ExactSearchResult ret;
+    if (table.size() == 0) {
+        ret.peak = ret.lowerBound = 0;
+        ret.optimal = ret.boundReached = true;
+        ret.nodes = 0;
+        return ret;
+    }
+    if (threads == 0) { threads = defaultThreadCount(); }
+
+    ExactSearch search(table, maxNodes, progress);
+    if (!search.stopped()) {
+        std::vector<ExactSearch::Task> tasks = search.split(64 * threads);
+        WorkStealingQueues<ExactSearch::Task> queues(threads);
+        for (size_t t = 0; t < tasks.size(); t++) {
+            queues.push(t % threads, tasks[t]);
+        }
+
+        std::vector<std::thread> workers;
+        for (unsigned w = 0; w < threads; w++) {
+            workers.push_back(std::thread([&search, &queues, w]() {
+                ExactSearch::Task task;
+                while (!search.stopped() && queues.pop(w, task)) {
+                    search.run(task);
+                }
+            }));
+        }
+        for (size_t w = 0; w < workers.size(); w++) {
+            workers[w].join();
+        }
+    }
+    return search.result(table);
+}
+
+AnnealResult annealRotations(PatternTable &table, unsigned starts
+    , unsigned long long steps, uint64_t seed, unsigned threads, SolveProgress *progress)
+{
+    AnnealResult ret;
+    ret.bestStart = 0;
+    if (table.size() == 0) {
+        ret.startPeak = ret.peak = 0;
+        return ret;
+    }
+    size_t bits = table.bits();
+    std::vector<int> sums = columnSums(table);
+    ret.startPeak = *std::max_element(sums.begin(), sums.end());
+    long startEnergy = annealEnergy(sums);
+
+    // Temperatures fall geometrically, from accepting a step up of a
+    // couple of columns at the maximum to accepting almost nothing.
+    // Without a step count they fall over the time left in the budget.
+    const double firstTemperature = 2.0;
+    const double lastTemperature = 0.05;
+    bool timed = (steps == 0 && progress && progress->budget() > 0);
+    double cooling = (steps > 1)
+        ? pow(lastTemperature / firstTemperature, 1.0 / (steps - 1)) : 1.0;
+    double timedStart = timed ? progress->elapsed() : 0;
+    double timedSpan = timed ? progress->budget() - timedStart : 0;
+
+    // The budget is checked once every this many steps.
+    const unsigned long long CHECK_STEPS = 1024;
+
+    std::vector<PatternTable> bestTables(starts);
+    std::vector<long> bestEnergies(starts, startEnergy);
+    parallelFor(starts, threads, [&](size_t s) {
+        SplitMix64 rng(seed ^ (0xD1B54A32D192ED03ULL * (s + 1)));
+        PatternTable work(table);
+        ColumnHistogram hist(work);
+        long energy = startEnergy;
+        long perPeak = static_cast<long>(bits + 1);
+        double temperature = firstTemperature;
+        unsigned long long step = 0;
+        for (; timed || step < steps; step++, temperature *= cooling) {
+            if (bits < 2) { break; }
+            if (progress && step % CHECK_STEPS == 0) {
+                if (progress->expired()) { break; }
+                if (timed) {
+                    double used = (progress->elapsed() - timedStart) / timedSpan;
+                    temperature = firstTemperature
+                        * pow(lastTemperature / firstTemperature, std::min(used, 1.0));
+                }
+            }
+            size_t row = rng.below(work.size());
+            Pattern before = work[row];
+            Pattern after = rotatePattern(before, 1 + rng.below(bits - 1), bits);
+            if (after == before) { continue; }
+            hist.remove(before);
+            hist.add(after);
+            long trial = annealEnergy(hist.counts());
+            if (trial <= energy || rng.uniform() < exp((energy - trial) / temperature)) {
+                work[row] = after;
+                energy = trial;
+                if (energy < bestEnergies[s]) {
+                    if (progress && energy / perPeak < bestEnergies[s] / perPeak) {
+                        progress->record("annealRotations", static_cast<int>(energy / perPeak));
+                    }
+                    bestEnergies[s] = energy;
+                    bestTables[s] = work;
+                }
+            }
+            else {
+                hist.remove(after);
+                hist.add(before);
+            }
+        }
+        LED_STATS_COUNT(rotationChecks, step);
+    });
+
+    // Keep the best start, preferring the lowest-numbered on ties.
+    long bestEnergy = startEnergy;
+    for (unsigned s = 0; s < starts; s++) {
+        if (bestEnergies[s] < bestEnergy) {
+            bestEnergy = bestEnergies[s];
+            ret.bestStart = s;
+        }
+    }
+    if (bestEnergy < startEnergy) {
+        table = bestTables[ret.bestStart];
+    }
+    sums = columnSums(table);
+    ret.peak = *std::max_element(sums.begin(), sums.end());
+    return ret;
+}
+
+bool parseRange(const std::string &text, std::vector<int> &values)
+{
+    std::stringstream items(text);
+    std::string item;
+    values.clear();
+    while (std::getline(items, item, ',')) {
+        long parts[3] = { 0, 0, 1 };
+        size_t count = 0;
+        const char *s = item.c_str();
+        for (;;) {
+            char *end;
+            if (count == 3) { return false; }
+            parts[count++] = strtol(s, &end, 10);
+            if (end == s) { return false; }
+            if (*end == '\0') { break; }
+            if (*end != ':') { return false; }
+            s = end + 1;
+        }
+        if (count == 1) { parts[1] = parts[0]; }
+        if (parts[2] <= 0 || parts[1] < parts[0]) { return false; }
+        for (long v = parts[0]; v <= parts[1]; v += parts[2]) {
+            values.push_back(static_cast<int>(v));
+        }
+    }
+    return !values.empty();
+}
+
+std::vector<SweepRow> sweep(const std::vector<int> &LEDs, const std::vector<int> &bits
+    , const std::vector<int> &parities, const std::vector<int> &strides
+    , bool simple_encoding, unsigned stride_optimizations, unsigned threads)
+{
+    std::vector<SweepRow> rows;
+    if (LEDs.empty() || bits.empty() || parities.empty() || strides.empty()) { return rows; }
+
+    // The parity does not affect the simple encoding.
+    std::vector<int> sweepParities(parities);
+    if (simple_encoding) { sweepParities.assign(1, 0); }
+
+    // Build the patterns for the largest LED count that fits once for
+    // each combination of bits and parity; smaller counts use a prefix.
+    // Counts that do not fit are known from encodingCapacity() without
+    // building anything.
+    size_t nSets = bits.size() * sweepParities.size();
+    std::vector<PatternTable> patternSets(nSets);
+    std::vector<uint64_t> capacities(nSets, 0);
+    for (size_t s = 0; s < nSets; s++) {
+        int b = bits[s / sweepParities.size()];
+        int parity = sweepParities[s % sweepParities.size()];
+        if (b > 0) { capacities[s] = encodingCapacity(b, parity, simple_encoding); }
+    }
+    parallelFor(nSets, threads, [&](size_t s) {
+        int b = bits[s / sweepParities.size()];
+        int parity = sweepParities[s % sweepParities.size()];
+        int maxLEDs = 0;
+        for (size_t l = 0; l < LEDs.size(); l++) {
+            if (LEDs[l] > maxLEDs && static_cast<uint64_t>(LEDs[l]) <= capacities[s]) {
+                maxLEDs = LEDs[l];
+            }
+        }
+        if (b <= 0 || maxLEDs <= 0) { return; }
+        if (simple_encoding) {
+            simpleEncodeInto(patternSets[s], maxLEDs, b);
+        }
+        else {
+            greedyEncodeInto(patternSets[s], maxLEDs, b, parity);
+        }
+    });
+
+    size_t nConfigs = nSets * LEDs.size() * strides.size();
+    rows.resize(nConfigs);
+    parallelFor(nConfigs, threads, [&](size_t c) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t s = c / (LEDs.size() * strides.size());
+        SweepRow &row = rows[c];
+        row.LEDs = LEDs[(c / strides.size()) % LEDs.size()];
+        row.bits = bits[s / sweepParities.size()];
+        row.parity = sweepParities[s % sweepParities.size()];
+        row.stride = strides[c % strides.size()];
+        row.feasible = (row.LEDs > 0)
+            && (patternSets[s].size() >= static_cast<size_t>(row.LEDs));
+        row.maxBrightness = row.minimum = 0;
+        if (row.feasible) {
+            PatternTable table(patternSets[s]);
+            table.resize(row.LEDs);
+            shiftTable(table, row.stride, stride_optimizations);
+            std::vector<int> sums = columnSums(table);
+            row.maxBrightness = *std::max_element(sums.begin(), sums.end());
+            row.minimum = theoreticalMinimum(sums, table.bits());
+        }
+        row.seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    });
+    return rows;
+}
+
+namespace {
+
+    // Check the parameters and fill 'result.unshifted' with the
+    // encodings, not shifted, from the scratch's pattern cache if it
+    // has one.
+    SolveStatus encodeForSolve(const SolveParameters &params, SolveResult &result
+        , SolveScratch &scratch)
+    {
+        result.status = SOLVE_BAD_PARAMETERS;
+        if (params.parity > 2 || params.bits == 0 || params.bits > MAX_PATTERN_BITS) {
+            return result.status;
+        }
+        if (params.LEDs > encodingCapacity(params.bits, params.parity, params.simple_encoding)) {
+            result.status = SOLVE_NOT_ENOUGH_BITS;
+            return result.status;
+        }
+
+        if (params.simple_encoding) {
+            simpleEncodeInto(result.unshifted, params.LEDs, params.bits);
+        }
+        else {
+            greedyEncodeInto(result.unshifted, params.LEDs, params.bits, params.parity
+                , params.maximize_distance, params.threads, scratch.necklaces);
+        }
+
+        // Make sure our construction worked.
+        if (result.unshifted.size() == 0 || result.unshifted.size() < params.LEDs) {
+            result.status = SOLVE_NOT_ENOUGH_BITS;
+            return result.status;
+        }
+        result.status = SOLVE_OK;
+        return result.status;
+    }
+
+    // Run the stronger searches on the shifted table if asked, then
+    // fill in its histogram, bounds and trajectory.
+    void finishSolve(const SolveParameters &params, SolveResult &result
+        , SolveScratch &scratch)
+    {
+        SolveProgress &progress = scratch.progress;
+        if (params.anneal_starts > 0) {
+            ScopedPhase phase("annealRotations");
+            result.anneal = annealRotations(result.table, params.anneal_starts
+                , params.anneal_steps, params.seed, params.threads, &progress);
+        }
+        if (params.exact) {
+            ScopedPhase phase("exactMinimumPeak");
+            result.exact = exactMinimumPeak(result.table, params.exact_nodes, params.threads
+                , &progress);
+        }
+
+        columnSums(result.table, result.histogram);
+        result.peak = *std::max_element(result.histogram.begin(), result.histogram.end());
+        result.bound = theoreticalMinimum(result.histogram, result.table.bits());
+        result.lowerBound = peakLowerBound(result.table, scratch.overlaps.bound);
+        progress.trajectory(result.trajectory);
+        result.timedOut = progress.interrupted();
+        result.status = SOLVE_OK;
+    }
+
+} // namespace
+
+SolveStatus solve(const SolveParameters &params, SolveResult &result, SolveScratch &scratch)
+{
+    if (encodeForSolve(params, result, scratch) != SOLVE_OK) { return result.status; }
+
+    // Shift the encodings to reduce the maximum brightness, then try
+    // the stronger searches if asked.
+    result.table = result.unshifted;
+    scratch.progress.restart(params.time_budget);
+    shiftTable(result.table, params.stride, params.stride_optimizations, scratch.histogram
+        , &scratch.progress, &scratch.overlaps);
+    finishSolve(params, result, scratch);
+    return result.status;
+}
+
+SolveStatus solve(const SolveParameters &params, SolveResult &result)
+{
+    SolveScratch scratch;
+    return solve(params, result, scratch);
+}
+
+SolveStatus warmSolve(const SolveParameters &params, const PatternView &previous
+    , SolveResult &result, SolveScratch &scratch)
+{
+    if (encodeForSolve(params, result, scratch) != SOLVE_OK) { return result.status; }
+    scratch.progress.restart(params.time_budget);
+    {
+        ScopedPhase phase("warmStartTable");
+        result.warm = warmStartTable(previous, result.unshifted, result.table
+            , params.stride_optimizations, scratch.histogram, &scratch.progress, &scratch.overlaps);
+    }
+    finishSolve(params, result, scratch);
+    return result.status;
+}
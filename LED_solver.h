@@ -0,0 +1,853 @@
+// Library for computing LED bright/dark patterns for the OSVR HDK and
+// packing their time offsets to limit the instantaneous power draw.
+// The LED_encoding program is a command-line front end for it; other
+// tools can call solve() directly.
+
+#ifndef LED_SOLVER_H
+#define LED_SOLVER_H
+
+#include "LED_rotations.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// A pattern of high-power (1) and low-power (0) fields packed into
+// a single word.  Field 0 is stored in the most-significant of the
+// pattern's bits, so that comparing two patterns as integers orders
+// them the same way as comparing their fields one at a time.
+typedef uint64_t Pattern;
+
+// Largest number of fields that fit into a Pattern.
+const size_t MAX_PATTERN_BITS = 64;
+
+// Mask covering the low 'bits' bits of a Pattern.
+inline Pattern patternMask(size_t bits)
+{
+    if (bits >= MAX_PATTERN_BITS) { return ~static_cast<Pattern>(0); }
+    return (static_cast<Pattern>(1) << bits) - 1;
+}
+
+// Return the number of 1 fields in a pattern.
+inline unsigned patternWeight(Pattern p)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<unsigned>(__popcnt64(p));
+#elif defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_popcountll(p));
+#else
+    unsigned count = 0;
+    while (p) {
+        count++;
+        p &= p - 1;
+    }
+    return count;
+#endif
+}
+
+// Return the value (0 or 1) of field 'col' in a 'bits'-field pattern.
+inline int patternField(Pattern p, size_t col, size_t bits)
+{
+    return static_cast<int>((p >> (bits - 1 - col)) & 1);
+}
+
+// Set field 'col' in a 'bits'-field pattern to 1.
+inline Pattern setPatternField(Pattern p, size_t col, size_t bits)
+{
+    return p | (static_cast<Pattern>(1) << (bits - 1 - col));
+}
+
+// Rotate a 'bits'-field pattern so that field 'k' becomes field 0.
+// This matches std::rotate(begin, begin + k, end) on an unpacked row.
+inline Pattern rotatePattern(Pattern p, size_t k, size_t bits)
+{
+    k %= bits;
+    if (k == 0) { return p; }
+    return ((p << k) | (p >> (bits - k))) & patternMask(bits);
+}
+
+// A table of patterns that all have the same number of fields,
+// stored contiguously with one packed word per row.  Clearing or
+// reassigning a table keeps its storage, so a table that is reused
+// does not allocate once it has grown to size.
+class PatternTable
+{
+public:
+    typedef std::vector<Pattern>::iterator iterator;
+    typedef std::vector<Pattern>::const_iterator const_iterator;
+
+    explicit PatternTable(size_t bits = 0) : m_bits(bits) {}
+
+    // Number of fields in each row.
+    size_t bits() const { return m_bits; }
+
+    // Remove all rows and change the number of fields per row.
+    void reset(size_t bits)
+    {
+        m_bits = bits;
+        m_rows.clear();
+    }
+
+    size_t size() const { return m_rows.size(); }
+    bool empty() const { return m_rows.empty(); }
+    void clear() { m_rows.clear(); }
+    void reserve(size_t rows) { m_rows.reserve(rows); }
+    void push_back(Pattern p) { m_rows.push_back(p); }
+    void insert(size_t row, Pattern p) { m_rows.insert(m_rows.begin() + row, p); }
+    void resize(size_t rows) { m_rows.resize(rows); }
+
+    Pattern &operator[](size_t row) { return m_rows[row]; }
+    Pattern operator[](size_t row) const { return m_rows[row]; }
+    const Pattern *data() const { return m_rows.data(); }
+
+    iterator begin() { return m_rows.begin(); }
+    iterator end() { return m_rows.end(); }
+    const_iterator begin() const { return m_rows.begin(); }
+    const_iterator end() const { return m_rows.end(); }
+
+private:
+    size_t m_bits;
+    std::vector<Pattern> m_rows;
+};
+
+// A read-only view of rows of patterns stored elsewhere, such as in a
+// PatternTable or in a memory-mapped cache file.  A PatternTable
+// converts to a view of all of its rows.
+class PatternView
+{
+public:
+    PatternView() : m_rows(0), m_size(0), m_bits(0) {}
+    PatternView(const Pattern *rows, size_t size, size_t bits)
+        : m_rows(rows), m_size(size), m_bits(bits) {}
+    PatternView(const PatternTable &table)
+        : m_rows(table.data()), m_size(table.size()), m_bits(table.bits()) {}
+
+    size_t bits() const { return m_bits; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    Pattern operator[](size_t row) const { return m_rows[row]; }
+    const Pattern *data() const { return m_rows; }
+
+private:
+    const Pattern *m_rows;
+    size_t m_size;
+    size_t m_bits;
+};
+
+// Compute parity of unsigned n. It returns 1
+// if n has odd parity, and returns 0 if n has even
+// parity.
+bool hasOddParity(unsigned int n);
+
+// Number of fields produced by encodePattern() for a given number of
+// data bits.
+size_t encodedPatternBits(size_t bits);
+
+// Return the encoding of an LED's pattern.  The pattern consists of
+// high-power (1) and low-power (0) fields encoded as described in the
+// "OSVR: HDK LED Patterns" document, and has encodedPatternBits(bits)
+// fields.
+// If there are not enough bits to encode the pattern, or the encoding
+// does not fit in a Pattern, returns an all-zero pattern (which is
+// never a valid encoding because of the start-of-frame marker).
+Pattern encodePattern(unsigned int ID, size_t bits);
+
+// Return the canonical rotation of a 'bits'-field pattern: the one
+// that sorts first when a 1 field is taken to come before a 0 field,
+// which is the rotation with the largest integer value.  Two patterns
+// are rotations of one another exactly when their canonical rotations
+// are equal.
+Pattern canonicalRotation(Pattern p, size_t bits);
+
+// Return the number of distinct rotations of a 'bits'-field pattern,
+// which is the length of its shortest repeating period.
+size_t patternPeriod(Pattern p, size_t bits);
+
+// Recursive step of the Fredricksen-Kessler-Maiorana necklace
+// generator, restricted to patterns with a fixed number of 1 fields.
+// A 1 field is treated as the smaller symbol, so the patterns produced
+// are canonical rotations and come out in decreasing integer order.
+//   't' is the 1-based position being filled in, 'p' is the period of
+// the longest prenecklace that is a prefix of 'prefix', and 'ones' and
+// 'zeros' are how many of each field we still have to place.
+// Returns false if the visitor asked to stop.
+template <class Visitor>
+bool recursiveNecklaces(size_t bits, size_t t, size_t p
+    , size_t ones, size_t zeros, Pattern prefix, Visitor &visitor)
+{
+    // Once the pattern is full it is a necklace if the prenecklace
+    // period divides its length.
+    if (t > bits) {
+        if (bits % p == 0) { return visitor(prefix); }
+        return true;
+    }
+
+    // The symbol 'p' fields back is the one that keeps the current
+    // period; position 0 is a sentinel that behaves like a 1 field.
+    bool referenceIsOne = (t == p) || (patternField(prefix, t - p - 1, bits) != 0);
+    if (referenceIsOne) {
+        // Repeat the 1 to keep the period, or place a 0 (the larger
+        // symbol) and start a new period here.
+        if (ones > 0 && !recursiveNecklaces(bits, t + 1, p, ones - 1, zeros
+                , setPatternField(prefix, t - 1, bits), visitor)) {
+            return false;
+        }
+        if (zeros > 0 && !recursiveNecklaces(bits, t + 1, t, ones, zeros - 1
+                , prefix, visitor)) {
+            return false;
+        }
+    }
+    else {
+        // A 0 is the largest symbol, so it can only be repeated.
+        if (zeros > 0 && !recursiveNecklaces(bits, t + 1, p, ones, zeros - 1
+                , prefix, visitor)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Call visitor(pattern) once for each rotationally-distinct 'bits'-field
+// pattern with 'ones' of its fields being 1, passing the canonical
+// rotation of each.  Patterns are produced in decreasing integer order
+// without comparing against any of the ones already produced.  The
+// visitor returns false to stop the enumeration early, in which case
+// this function also returns false.
+template <class Visitor>
+bool enumerateNecklaces(size_t ones, size_t bits, Visitor &visitor)
+{
+    if (bits == 0 || bits > MAX_PATTERN_BITS || ones > bits) { return true; }
+    return recursiveNecklaces(bits, 1, 1, ones, bits - ones, 0, visitor);
+}
+
+// Visitor for enumerateNecklaces() that appends to a table, stopping
+// once the table holds 'limit' rows (0 means no limit).
+struct AppendToTable
+{
+    AppendToTable(PatternTable &table, size_t limit) : m_table(table), m_limit(limit) {}
+    bool operator()(Pattern p)
+    {
+        m_table.push_back(p);
+        return (m_limit == 0) || (m_table.size() < m_limit);
+    }
+    PatternTable &m_table;
+    size_t m_limit;
+};
+
+// Construct all of the rotationally-invariant b-bit patterns with
+// "ones" of the bits being 1.  Optionally, stop after 'maxPatterns'
+// of them have been found (0 means find them all).
+PatternTable constructRotationallyInvariant(size_t ones, size_t bits, size_t maxPatterns = 0);
+
+// A cache of constructRotationallyInvariant() results shared by threads,
+// for programs that solve many configurations.  Each weight and length
+// keeps the longest prefix of its patterns asked for so far, and a
+// longer one is built by enumerating at least twice as many.
+class NecklaceCache
+{
+public:
+    // The first 'count' patterns with 'ones' of the 'bits' bits set (0
+    // means all of them), or all of them if there are fewer.
+    std::shared_ptr<const PatternTable> patterns(size_t ones, size_t bits, size_t count);
+
+    // Drop everything.
+    void clear();
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const PatternTable> patterns;
+        bool all;                   // True if there are no more patterns
+    };
+    std::mutex m_mutex;
+    std::map<std::pair<size_t, size_t>, Entry> m_entries;
+};
+
+// Collect the patterns for an optimal encoding of up to 'LEDs' LEDs in
+// 'bits' bits into 'table', replacing what was there.  It starts with
+// the smallest number of "1" bits and includes all encodings with that
+// number of bits that are not rotationally symmetric with each other,
+// then moves up to a larger number of "1" bits until it has found
+// enough values to encode the requested number of LEDs or runs out of
+// patterns.
+//   The parity can be specified as 0 (none), 1 (odd), or 2 (even).
+// If specified, only patterns with the designated parity will be
+// included.
+//   Because the patterns always come out in the same order, the
+// encoding for fewer LEDs is a prefix of the encoding for more.
+//   If 'maximizeDistance' is set, the patterns with the largest number
+// of "1" bits, which only partly fill the table, are instead picked one
+// at a time as the candidate farthest (by rotationalDistance()) from
+// those already in the table, preferring the fewest patterns at that
+// distance.  Every candidate has the same number of "1" bits, so the
+// brightness budget is unchanged.  Only the first
+// MAX_DISTANCE_CANDIDATES (or four times as many as are needed, if
+// more) candidates are considered, and the work is spread over
+// 'threads' workers (0 means one per core).  The prefix property no
+// longer holds.
+//   If 'cache' is given, the patterns come from it rather than being
+// enumerated each time.
+void greedyEncodeInto(PatternTable &table, size_t LEDs, size_t bits, unsigned parity
+    , bool maximizeDistance = false, unsigned threads = 0, NecklaceCache *cache = NULL);
+
+// As greedyEncodeInto(), returning a new table.
+PatternTable greedyEncodeUpTo(size_t LEDs, size_t bits, unsigned parity
+    , bool maximizeDistance = false, unsigned threads = 0);
+
+// Find an optimal encoding for 'LEDs' count of LEDs in 'bits' bits,
+// as described for greedyEncodeInto().
+//   Returns an empty table if it cannot find enough encodings
+// matching the specified constraints.
+PatternTable greedyOptimalEncode(size_t LEDs, size_t bits, unsigned parity
+    , bool maximizeDistance = false, unsigned threads = 0);
+
+// How many candidate patterns greedyEncodeInto() considers at least
+// when maximizing the distance between patterns.
+const size_t MAX_DISTANCE_CANDIDATES = 4096;
+
+// Collect the simple encodings of LEDs 0 through LEDs-1 into 'table',
+// replacing what was there and stopping early if there are not enough
+// bits to encode them all.
+void simpleEncodeInto(PatternTable &table, size_t LEDs, size_t bits);
+
+// As simpleEncodeInto(), returning a new table.
+PatternTable simpleEncodeUpTo(size_t LEDs, size_t bits);
+
+// Number of distinct 'bits'-field patterns with 'ones' 1 fields when
+// patterns that are rotations of one another count once (the binary
+// necklaces), which is how many constructRotationallyInvariant() finds.
+// It is counted by Burnside's lemma rather than by enumeration:
+//     (1 / bits) * sum over d dividing both bits and ones of
+//         phi(d) * C(bits / d, ones / d)
+uint64_t necklaceCount(size_t ones, size_t bits);
+
+// How many LEDs can be encoded in 'bits' bits with the given parity,
+// as greedyEncodeInto() would, or with encodePattern() if
+// 'simple_encoding' is set (in which case the parity does not matter).
+// Nothing is enumerated, so this answers at once even where building
+// the table would take a long time.
+uint64_t encodingCapacity(size_t bits, unsigned parity, bool simple_encoding = false);
+
+// The fewest bits that can encode 'LEDs' LEDs with the given parity,
+// or 0 if there are not enough patterns of any length.
+size_t minimumEncodingBits(size_t LEDs, unsigned parity, bool simple_encoding = false);
+
+// Total number of 1 fields in the encoding of 'LEDs' LEDs, or 0 if
+// they do not fit.  The greedy encoding takes the lightest patterns, so
+// for it this is the least weight any table of distinct patterns can
+// have, and theoreticalMinimum() of any shifting of it is this divided
+// by the number of fields, rounded up.
+uint64_t encodingWeight(size_t LEDs, size_t bits, unsigned parity, bool simple_encoding = false);
+
+// Compute a histogram of column sums for a table into 'sums'.
+// Optionally, specify the number of rows.  If the number of rows is
+// specified as 0, all rows in the table are used.
+void columnSums(const PatternView &table, std::vector<int> &sums, size_t nRows = 0);
+
+// Compute a vector that is a histogram of column sums
+// for a table, as above.
+std::vector<int> columnSums(const PatternView &table, size_t nRows = 0);
+
+// A running histogram of column sums that rows can be added to and
+// removed from, so that the effect of placing one row can be evaluated
+// without rescanning the whole table.
+class ColumnHistogram
+{
+public:
+    explicit ColumnHistogram(size_t bits = 0) : m_bits(bits), m_counts(bits, 0) {}
+
+    // Histogram of the first 'nRows' rows of a table (0 means all rows).
+    explicit ColumnHistogram(const PatternTable &table, size_t nRows = 0)
+        : m_bits(table.bits()) { columnSums(table, m_counts, nRows); }
+
+    // Empty the histogram and change its number of columns, keeping
+    // its storage.
+    void reset(size_t bits)
+    {
+        m_bits = bits;
+        m_counts.assign(bits, 0);
+    }
+
+    // Replace the histogram with that of the first 'nRows' rows of a
+    // table (0 means all rows), keeping its storage.
+    void assign(const PatternTable &table, size_t nRows = 0)
+    {
+        m_bits = table.bits();
+        columnSums(table, m_counts, nRows);
+    }
+
+    size_t bits() const { return m_bits; }
+    const std::vector<int> &counts() const { return m_counts; }
+
+    void add(Pattern p)
+    {
+        for (size_t col = 0; col < m_bits; col++) {
+            m_counts[col] += patternField(p, col, m_bits);
+        }
+    }
+
+    void remove(Pattern p)
+    {
+        for (size_t col = 0; col < m_bits; col++) {
+            m_counts[col] -= patternField(p, col, m_bits);
+        }
+    }
+
+    // The rotation of 'p' to add for the smallest largest column sum;
+    // see lowestPeakRotation() and bestRotation() in LED_rotations.h.
+    size_t lowestPeakRotation(Pattern p) const
+    {
+        return ::lowestPeakRotation(m_counts.data(), m_bits, p);
+    }
+    size_t bestRotation(Pattern p) const
+    {
+        return ::bestRotation(m_counts.data(), m_bits, p);
+    }
+
+    // Find the largest and smallest column sums that would result from
+    // adding the pattern, without changing the histogram.
+    void extremesWith(Pattern p, int &maxCount, int &minCount) const
+    {
+        maxCount = m_counts[0] + patternField(p, 0, m_bits);
+        minCount = maxCount;
+        for (size_t col = 1; col < m_bits; col++) {
+            int count = m_counts[col] + patternField(p, col, m_bits);
+            if (count > maxCount) { maxCount = count; }
+            if (count < minCount) { minCount = count; }
+        }
+    }
+
+private:
+    size_t m_bits;
+    std::vector<int> m_counts;
+};
+
+// One improvement of the maximum brightness during a solve.
+struct TrajectoryPoint
+{
+    double seconds;                 // Time since the optimization started
+    int peak;                       // Maximum brightness reached
+    const char *phase;              // The phase that reached it
+};
+
+// A wall-clock budget for optimizing a table, and the record of how its
+// maximum brightness fell over time.  The optimizers that take one
+// check it as they go and, once it has expired, return at once with the
+// best layout they have, which is always a valid table; they record
+// each improvement on the best layout so far.  It may be shared by
+// threads.
+class SolveProgress
+{
+public:
+    // Start the clock.  A budget of 0 (or less) seconds never expires.
+    explicit SolveProgress(double budget = 0);
+
+    // Forget the trajectory, keeping its storage, and start the clock
+    // again with a new budget.
+    void restart(double budget);
+
+    // Seconds since the clock started, and the budget.
+    double elapsed() const;
+    double budget() const { return m_budget; }
+
+    // True once the budget has run out.
+    bool expired() const;
+
+    // True if an optimizer has seen the budget run out, and so may
+    // have stopped short.
+    bool interrupted() const { return m_interrupted; }
+
+    // Record that a phase brought the maximum brightness to 'peak'; it
+    // is ignored unless it is lower than the last one recorded.
+    void record(const char *phase, int peak);
+
+    // Copy the improvements recorded so far, in order, into 'points'.
+    void trajectory(std::vector<TrajectoryPoint> &points) const;
+
+private:
+    SolveProgress(const SolveProgress &);
+    SolveProgress &operator=(const SolveProgress &);
+
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_deadline;
+    double m_budget;
+    mutable std::atomic<bool> m_interrupted;
+    mutable std::mutex m_mutex;
+    std::vector<TrajectoryPoint> m_trajectory;
+};
+
+// Rotate each row i of the table so that it starts i * stride fields
+// later than the first row.
+void applyFixedStride(int stride, PatternTable &table);
+
+// Attempt to rotate the second and following rows such that
+// the maximum number of overlapping bright LEDs in a single
+// column for that row plus all the ones above it is minimized.
+// Repeating this function will select different solutions;
+// it picks the maximum equivalent rotation each time.
+//   The histogram is working storage.  If the progress's budget runs
+// out, the rows not yet placed are left as they were.
+void greedyOptimumStride(PatternTable &table, ColumnHistogram &scratch
+    , SolveProgress *progress = NULL);
+void greedyOptimumStride(PatternTable &table);
+
+// Attempt to rotate all rows such that the maximum number of
+// overlapping bright LEDs in a single column is minimized.
+// It also attempts to maximize the minimum maximum count over
+// all columns, to try and level the number of 1's per column.
+// Repeating this function will select different solutions;
+// it picks the maximum equivalent rotation for each row
+// each time it is run.
+//   The histogram is working storage.  Returns how many rows it rotated.
+// If the progress's budget runs out, the pass stops after the current
+// row; no row's rotation raises the maximum brightness, so the table is
+// no worse than it was.
+size_t greedyReduceOverlaps(PatternTable &table, ColumnHistogram &scratch
+    , SolveProgress *progress = NULL);
+size_t greedyReduceOverlaps(PatternTable &table);
+
+// Working storage for peakLowerBound(): the differences between the
+// halves of each row and the subset sums they reach.
+struct LowerBoundScratch
+{
+    std::vector<size_t> differences;
+    std::vector<uint64_t> reachable;
+};
+
+// Working storage for the overlap passes of shiftTable() and
+// warmStartTable(): the layouts earlier passes left, and the lower bound
+// they stop at.
+struct OverlapScratch
+{
+    std::vector<uint64_t> layouts;
+    LowerBoundScratch bound;
+};
+
+// Shift the rows of an unshifted encoding table to reduce the maximum
+// brightness.  The rows are first reversed to put the ones with the
+// most bits first.  If the stride is negative, we do a greedy
+// optimization; otherwise it is used consistently across the board.
+// Then up to 'stride_optimizations' passes of greedyReduceOverlaps() try
+// to improve the result.  They stop early once the maximum brightness
+// reaches peakLowerBound(), a pass rotates no rows, or a pass returns
+// the table to a layout an earlier pass left, after which the passes
+// would only cycle.  No pass raises the maximum brightness, so stopping
+// early does not change it.
+//   If a progress is given, the shifting and the passes stop when its
+// budget runs out, and the maximum brightness is recorded after the
+// first shift and after each pass that lowers it.  The passes keep
+// their working storage in 'overlaps' if it is given, and otherwise
+// allocate their own.
+void shiftTable(PatternTable &table, int stride, unsigned stride_optimizations
+    , ColumnHistogram &scratch, SolveProgress *progress = NULL, OverlapScratch *overlaps = NULL);
+void shiftTable(PatternTable &table, int stride, unsigned stride_optimizations);
+
+// How a table was rebuilt from a previous one by warmStartTable().
+struct WarmStartResult
+{
+    size_t kept;                    // Rows that kept their pattern and rotation
+    size_t placed;                  // Rows given a new or changed pattern
+    size_t dropped;                 // Previous rows past the new number of LEDs
+};
+
+// Rebuild a shifted table for a new set of patterns starting from a
+// previous shifted table, such as one read back from the CSV output,
+// so that a small change to the LEDs costs time in proportion to the
+// change.  Row i of the result is LED i.  It keeps its previous
+// rotation if its previous pattern is a rotation of one of the
+// patterns in 'unshifted' that no earlier row has kept.  The patterns
+// left over go to the other rows (and to new rows, if there are more
+// LEDs than before), heaviest first.  Each is rotated to the place
+// that adds least to the current histogram.  Then up to 'passes' passes
+// of greedyReduceOverlaps(), stopping early as in shiftTable(), may
+// perturb every row's rotation, which leaves each LED's pattern, and so
+// its ID, unchanged.
+//   The histogram is working storage.  A progress bounds the passes
+// and records their improvements as for shiftTable(); every row is
+// placed whatever the budget, so that the table is complete.  The
+// overlap storage is as for shiftTable().
+WarmStartResult warmStartTable(const PatternView &previous, const PatternTable &unshifted
+    , PatternTable &table, unsigned passes, ColumnHistogram &scratch
+    , SolveProgress *progress = NULL, OverlapScratch *overlaps = NULL);
+
+// Count up all of the 1's in a histogram and compute how many (at
+// minimum) must be lined up in a single column given the number of
+// bits, irrespective of the rotationally-invariant coding or packing
+// rotation chosen.
+int theoreticalMinimum(const std::vector<int> &sums, size_t bits);
+
+// Lower bound on the maximum column sum of the table under any rotation
+// of its rows, which is at least the average over the columns.  When
+// the number of fields is even it also splits the columns into even and
+// odd ones: each row puts its 1's into the two halves one way round or
+// the other depending on the parity of its rotation, and the most even
+// split of all of the 1's that those choices can reach (found by subset
+// sums) bounds the fuller half.  For example, the ten 20-field patterns
+// with two 1's at each distance from 1 to 10 average one 1 per column,
+// but cannot be split evenly, so some column must have two.
+//   The scratch is working storage, which keeps its storage between
+// calls.
+int peakLowerBound(const PatternView &table, LowerBoundScratch &scratch);
+int peakLowerBound(const PatternView &table);
+
+// Hamming distance between 'a' and the closest rotation of 'b'.  This
+// is how few misread fields it takes for one LED to be mistaken for
+// another, whatever phase it is seen at.
+inline int rotationalDistance(Pattern a, Pattern b, size_t bits)
+{
+    int best = static_cast<int>(bits);
+    for (size_t r = 0; r < bits && best > 0; r++) {
+        int d = static_cast<int>(patternWeight(a ^ rotatePattern(b, r, bits)));
+        if (d < best) { best = d; }
+    }
+    return best;
+}
+
+// The closest pair of rows in a table, as found by
+// minimumRotationalDistance().
+struct PairDistance
+{
+    int distance;                   // Smallest rotationalDistance() between rows, -1 if fewer than two
+    size_t first, second;           // The first pair of rows (first < second) that close
+    size_t pairs;                   // How many pairs of rows are that close
+};
+
+// Find the smallest rotationalDistance() between any two rows of a
+// table.  Each row's rotations are computed once and compared with the
+// rows after it as packed words, and the rows are spread over
+// 'threads' workers (0 means one per core).
+PairDistance minimumRotationalDistance(const PatternView &table, unsigned threads = 0);
+
+// Lower bound on the maximum column sum that can be reached by adding
+// 'remainingRows' more rows holding 'remainingOnes' 1's in total to a
+// histogram.  Each row adds at most one to any column, so the best
+// case fills the lowest columns first, each by at most 'remainingRows'.
+int fillLowerBound(const std::vector<int> &counts, size_t remainingOnes, size_t remainingRows);
+
+// Result of an exact search for the rotations giving the smallest
+// maximum column sum.
+struct ExactSearchResult
+{
+    int peak;                       // Best maximum column sum found
+    int lowerBound;                 // Proven lower bound on the maximum
+    bool optimal;                   // True if peak == lowerBound
+    bool boundReached;              // True if the optimum was proven by the bound
+    unsigned long long nodes;       // Search nodes expanded
+};
+
+// Search the rotations of all rows after the first for the layout with
+// the smallest maximum column sum, starting from the rotations already
+// in the table as the best known.  Subtrees are spread over 'threads'
+// workers (0 means one per core).  The search stops as soon as a layout
+// reaches the lower bound, after roughly 'maxNodes' search nodes if
+// that is not 0, or when the progress's budget runs out.  Each better
+// layout found is recorded in the progress.  The table is replaced by
+// the best layout found.
+ExactSearchResult exactMinimumPeak(PatternTable &table, unsigned long long maxNodes = 0
+    , unsigned threads = 0, SolveProgress *progress = NULL);
+
+// Return the number of worker threads to use when none is requested.
+unsigned defaultThreadCount();
+
+// Call body(i) for each i in [0, count) using 'threads' worker threads
+// (0 means one per core), handing out indices as workers become free.
+template <class Body>
+void parallelFor(size_t count, unsigned threads, Body body)
+{
+    if (threads == 0) { threads = defaultThreadCount(); }
+    if (threads > count) { threads = static_cast<unsigned>(count); }
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; i++) { body(i); }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < threads; w++) {
+        workers.push_back(std::thread([&next, &body, count]() {
+            for (size_t i = next++; i < count; i = next++) {
+                body(i);
+            }
+        }));
+    }
+    for (size_t w = 0; w < workers.size(); w++) {
+        workers[w].join();
+    }
+}
+
+// Small, fast random number generator (splitmix64) whose output depends
+// only on its seed, so that randomized searches are reproducible on
+// every platform.
+class SplitMix64
+{
+public:
+    explicit SplitMix64(uint64_t seed) : m_state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (m_state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform integer in [0, n).
+    size_t below(size_t n) { return static_cast<size_t>(next() % n); }
+
+    // Uniform real in [0, 1).
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+private:
+    uint64_t m_state;
+};
+
+// Result of annealRotations().
+struct AnnealResult
+{
+    int startPeak;                  // Maximum brightness before annealing
+    int peak;                       // Maximum brightness after annealing
+    unsigned bestStart;             // Which start produced the result
+};
+
+// Improve the rotations of the rows of a table by simulated annealing.
+// 'starts' independent runs of 'steps' moves each begin from the
+// table's current rotations and are spread over 'threads' worker
+// threads (0 means one per core).  Each move rotates one randomly
+// chosen row, so the order in which rows are visited is randomized as
+// well.  Each start draws from its own generator seeded from 'seed' and
+// the start number, so results do not depend on the number of threads.
+// The table is replaced by the best layout found, and is left alone if
+// no start improved on it.
+//   The starts stop early when the progress's budget runs out, and a
+// start that lowers the best maximum brightness records it.  If 'steps'
+// is 0 and the progress has a budget, each start runs until the budget
+// is spent, cooling with the fraction of the remaining time used rather
+// than with the steps taken; the result then depends on timing.
+AnnealResult annealRotations(PatternTable &table, unsigned starts
+    , unsigned long long steps, uint64_t seed, unsigned threads = 0
+    , SolveProgress *progress = NULL);
+
+// Parse a list of integers given as comma-separated values or ranges,
+// where a range is "first:last" or "first:last:step".  Returns false
+// if the string is not of that form.
+bool parseRange(const std::string &text, std::vector<int> &values);
+
+// One configuration evaluated by sweep().
+struct SweepRow
+{
+    int LEDs;
+    int bits;
+    int parity;
+    int stride;
+    bool feasible;                  // False if the LEDs could not be encoded
+    int maxBrightness;
+    int minimum;                    // theoreticalMinimum() of the result
+    double seconds;                 // Time spent shifting this configuration
+};
+
+// Evaluate every combination of the LED counts, bits, parities and
+// strides on a pool of threads (0 means one per core), returning one
+// row per combination with LEDs varying slowest after bits and parity,
+// and stride fastest.  Configurations that share bits and parity share
+// a pattern set, built once for the largest LED count.
+std::vector<SweepRow> sweep(const std::vector<int> &LEDs, const std::vector<int> &bits
+    , const std::vector<int> &parities, const std::vector<int> &strides
+    , bool simple_encoding, unsigned stride_optimizations, unsigned threads = 0);
+
+// Everything that describes one solve; the defaults match the
+// LED_encoding program's.
+struct SolveParameters
+{
+    SolveParameters()
+        : LEDs(40), bits(10), simple_encoding(false), parity(2)
+        , stride(-1), stride_optimizations(20)
+        , anneal_starts(0), anneal_steps(100000), seed(0)
+        , exact(false), exact_nodes(0), maximize_distance(false), threads(0)
+        , time_budget(0) {}
+
+    unsigned LEDs;                  // How many LEDs to encode
+    unsigned bits;                  // How many bits to encode them in
+    bool simple_encoding;           // Use encodePattern() rather than the greedy encoding
+    unsigned parity;                // 0 (none), 1 (odd) or 2 (even), greedy encoding only
+    int stride;                     // Fixed stride, or negative to optimize
+    unsigned stride_optimizations;  // Passes of greedyReduceOverlaps()
+    unsigned anneal_starts;         // Annealing runs, or 0 for none
+    unsigned long long anneal_steps;// Moves per annealing run
+    uint64_t seed;                  // Seed for annealing
+    bool exact;                     // Run exactMinimumPeak() on the result
+    unsigned long long exact_nodes; // Node limit for the exact search, 0 for none
+    bool maximize_distance;         // Pass maximizeDistance to greedyEncodeInto()
+    unsigned threads;               // Worker threads, 0 for one per core
+    double time_budget;             // Seconds for shifting and searching, 0 for no limit
+};
+
+enum SolveStatus
+{
+    SOLVE_OK,
+    SOLVE_BAD_PARAMETERS,           // Parameters out of range
+    SOLVE_NOT_ENOUGH_BITS           // The LEDs could not be encoded in the bits
+};
+
+// Everything produced by one solve.
+struct SolveResult
+{
+    SolveStatus status;
+    PatternTable unshifted;         // The encodings before shifting, one row per LED
+    PatternTable table;             // The shifted encodings, one row per LED
+    std::vector<int> histogram;     // Column sums of the shifted table
+    int peak;                       // Maximum brightness of the shifted table
+    int bound;                      // theoreticalMinimum() of the shifted table
+    int lowerBound;                 // peakLowerBound() of the shifted table
+    AnnealResult anneal;            // Set if annealing was requested
+    ExactSearchResult exact;        // Set if the exact search was requested
+    WarmStartResult warm;           // Set by warmSolve()
+    std::vector<TrajectoryPoint> trajectory;    // How the maximum brightness fell while shifting and searching
+    bool timedOut;                  // The time budget ran out before the searches finished
+};
+
+// Working storage for solve(), and an optional pattern cache that may be
+// shared with the scratch of other threads.
+struct SolveScratch
+{
+    SolveScratch() : necklaces(NULL) {}
+
+    ColumnHistogram histogram;
+    OverlapScratch overlaps;
+    SolveProgress progress;
+    NecklaceCache *necklaces;
+};
+
+// Encode and shift a table as described by the parameters.  On
+// success, returns SOLVE_OK with the tables, histogram and bounds in
+// 'result'; otherwise the status says why it failed.  Nothing is
+// printed.
+//   The optimization, from shifting the table through the searches, is
+// limited to 'params.time_budget' seconds if that is not 0, and the
+// result's trajectory records each improvement it made.
+//   The result's tables, histogram and trajectory keep their storage
+// between calls, as do the scratch's histogram, progress and overlap
+// storage (the layouts the passes have left and the lower bound's
+// subset sums).  So repeated solves of configurations no larger than
+// earlier ones do not allocate on the heap, except in the annealing and
+// exact searches; the solve_allocations test checks this.
+SolveStatus solve(const SolveParameters &params, SolveResult &result, SolveScratch &scratch);
+SolveStatus solve(const SolveParameters &params, SolveResult &result);
+
+// As solve(), but shift the table with warmStartTable() from a previous
+// shifted table instead of with shiftTable(), running
+// 'params.stride_optimizations' passes of greedyReduceOverlaps() over
+// the result.  The stride is not used.
+SolveStatus warmSolve(const SolveParameters &params, const PatternView &previous
+    , SolveResult &result, SolveScratch &scratch);
+
+#endif
@@ -0,0 +1,119 @@
+#include "LED_stats.h"
+
+#include <string.h>
+
+#if defined(_WIN32)
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+RunStats::RunStats()
+    : candidatesEnumerated(0)
+    , rotationChecks(0)
+    , columnSumsComputed(0)
+    , m_enabled(false)
+    , m_start(std::chrono::steady_clock::now())
+{
+}
+
+void RunStats::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_phases.clear();
+    candidatesEnumerated = 0;
+    rotationChecks = 0;
+    columnSumsComputed = 0;
+    m_start = std::chrono::steady_clock::now();
+}
+
+void RunStats::addPhase(const char *name, int iteration, double seconds, long long accepted)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (size_t i = 0; i < m_phases.size(); i++) {
+        PhaseStats &phase = m_phases[i];
+        if (phase.iteration == iteration && phase.name == name) {
+            phase.calls++;
+            phase.seconds += seconds;
+            if (accepted >= 0) {
+                phase.accepted = (phase.accepted < 0) ? accepted
+                    : phase.accepted + accepted;
+            }
+            return;
+        }
+    }
+    PhaseStats phase;
+    phase.name = name;
+    phase.iteration = iteration;
+    phase.calls = 1;
+    phase.seconds = seconds;
+    phase.accepted = accepted;
+    m_phases.push_back(phase);
+}
+
+std::vector<PhaseStats> RunStats::phases() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_phases;
+}
+
+void RunStats::writeJSON(std::ostream &out) const
+{
+    // Phase names are identifiers, so they need no escaping.
+    std::vector<PhaseStats> list = phases();
+    double total;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        total = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+    out << "{" << std::endl
+        << "    \"total_seconds\": " << total << "," << std::endl
+        << "    \"phases\": [";
+    for (size_t i = 0; i < list.size(); i++) {
+        out << (i == 0 ? "" : ",") << std::endl
+            << "        {\"name\": \"" << list[i].name << "\"";
+        if (list[i].iteration >= 0) { out << ", \"iteration\": " << list[i].iteration; }
+        out << ", \"calls\": " << list[i].calls
+            << ", \"seconds\": " << list[i].seconds;
+        if (list[i].accepted >= 0) { out << ", \"accepted\": " << list[i].accepted; }
+        out << "}";
+    }
+    out << std::endl << "    ]," << std::endl;
+#if defined(LED_ENCODING_STATS)
+    out << "    \"counters\": {" << std::endl
+        << "        \"candidates_enumerated\": " << candidatesEnumerated << "," << std::endl
+        << "        \"rotation_checks\": " << rotationChecks << "," << std::endl
+        << "        \"column_sums\": " << columnSumsComputed << std::endl
+        << "    }," << std::endl;
+#else
+    out << "    \"counters\": null," << std::endl;
+#endif
+    out << "    \"peak_memory_bytes\": " << peakMemoryBytes() << std::endl << "}";
+}
+
+RunStats &runStats()
+{
+    static RunStats stats;
+    return stats;
+}
+
+size_t peakMemoryBytes()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    memset(&counters, 0, sizeof(counters));
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) { return 0; }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0; }
+#if defined(__APPLE__)
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    // Reported in kilobytes.
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
@@ -0,0 +1,108 @@
+// Statistics about a run: the wall time spent in each phase of solving
+// and counters of the work done in the optimizers' inner loops.
+//   Phases are only timed while statistics are enabled at run time.
+// The counters are only compiled in when LED_ENCODING_STATS is defined;
+// otherwise LED_STATS_COUNT() expands to nothing, so that a build
+// without them runs exactly the uninstrumented code.
+
+#ifndef LED_STATS_H
+#define LED_STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Time spent in one phase, summed over every time it ran (phases run
+// once per configuration in a sweep).
+struct PhaseStats
+{
+    std::string name;
+    int iteration;                  // Pass number of a repeated phase, or -1
+    unsigned long long calls;       // How many times the phase ran
+    double seconds;                 // Total wall time
+    long long accepted;             // Row rotations the phase accepted, or -1 if it does not say
+};
+
+class RunStats
+{
+public:
+    RunStats();
+
+    // Turn timing of phases on or off.  It starts off.
+    void enable(bool on) { m_enabled = on; }
+    bool enabled() const { return m_enabled; }
+
+    // Forget all phases, zero the counters and restart the clock for the
+    // total time.
+    void reset();
+
+    // Add to the totals of a phase, creating it if it is new.
+    void addPhase(const char *name, int iteration, double seconds, long long accepted);
+    std::vector<PhaseStats> phases() const;
+
+    // Write the total time since the statistics were created or reset,
+    // the phases, the counters (if compiled in) and the peak memory use
+    // as a JSON object.
+    void writeJSON(std::ostream &out) const;
+
+    // Work counters, updated through LED_STATS_COUNT().
+    std::atomic<unsigned long long> candidatesEnumerated;   // Patterns produced by the encoders
+    std::atomic<unsigned long long> rotationChecks;         // Row rotations scored against a histogram
+    std::atomic<unsigned long long> columnSumsComputed;     // Histograms computed from a whole table
+
+private:
+    std::atomic<bool> m_enabled;
+    mutable std::mutex m_mutex;
+    std::vector<PhaseStats> m_phases;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// The statistics for this process.
+RunStats &runStats();
+
+// Largest amount of memory the process has had resident, in bytes, or 0
+// if the platform does not say.
+size_t peakMemoryBytes();
+
+// Times the scope it is declared in as a phase, if statistics are
+// enabled when it is constructed.
+class ScopedPhase
+{
+public:
+    explicit ScopedPhase(const char *name, int iteration = -1)
+        : m_name(name), m_iteration(iteration), m_accepted(-1)
+        , m_enabled(runStats().enabled())
+    {
+        if (m_enabled) { m_start = std::chrono::steady_clock::now(); }
+    }
+    ~ScopedPhase()
+    {
+        if (m_enabled) {
+            runStats().addPhase(m_name, m_iteration, std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - m_start).count(), m_accepted);
+        }
+    }
+
+    void setAccepted(long long accepted) { m_accepted = accepted; }
+
+private:
+    ScopedPhase(const ScopedPhase &);
+    ScopedPhase &operator=(const ScopedPhase &);
+
+    const char *m_name;
+    int m_iteration;
+    long long m_accepted;
+    bool m_enabled;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#if defined(LED_ENCODING_STATS)
+#define LED_STATS_COUNT(counter, n) (runStats().counter += (n))
+#else
+#define LED_STATS_COUNT(counter, n) ((void)0)
+#endif
+
+#endif
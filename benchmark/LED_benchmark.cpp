@@ -0,0 +1,385 @@
+// Microbenchmarks for the encoding kernels in the LED_solver library.  Each
+// kernel is timed over a grid of bit counts and LED counts, printed as
+// one scaling table per kernel, and optionally written out as CSV.
+
+#include "LED_solver.h"
+#include "LED_decoder.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// Written to so that the compiler cannot discard the work being timed.
+volatile uint64_t benchmarkSink;
+
+void BenchmarkUsage(std::string name)
+{
+    std::cout << "Usage: " << name << " [-bits L] [-LEDs L] [-kernel NAME] [-rotations NAME] [-min_time S] [-csv FILE]" << std::endl;
+    std::cout << "       -bits: Comma-separated bit counts to test (default 8,12,16,20,24,28,32)" << std::endl;
+    std::cout << "       -LEDs: Comma-separated LED counts to test (default 10,20,50,100,200,500,1000,2000)" << std::endl;
+    std::cout << "       -kernel: Only run the named kernel (default all)" << std::endl;
+    std::cout << "       -rotations: Place rows with the scalar, sse4.1 or avx2 rotation kernel (default the fastest supported)" << std::endl;
+    std::cout << "       -min_time: Minimum seconds to time each measurement (default 0.02)" << std::endl;
+    std::cout << "       -csv: Write the results to FILE as comma-separated values" << std::endl;
+    exit(-1);
+}
+
+// A kernel to be timed for one configuration.  setup() is called once
+// and is not timed; run() is timed and returns a value for the sink.
+// setup() returns false if the configuration cannot be built.
+class Kernel
+{
+public:
+    virtual ~Kernel() {}
+    virtual const char *name() const = 0;
+    virtual bool setup(size_t bits, size_t LEDs) = 0;
+    virtual uint64_t run() = 0;
+};
+
+// Build the table that the optimizers would start from: the greedy
+// encoding with no parity, heaviest patterns first.
+bool benchmarkTable(size_t bits, size_t LEDs, PatternTable &table)
+{
+    table = greedyOptimalEncode(LEDs, bits, 0);
+    std::reverse(table.begin(), table.end());
+    return table.size() == LEDs;
+}
+
+class EncodePatternKernel : public Kernel
+{
+public:
+    const char *name() const { return "encodePattern"; }
+    bool setup(size_t bits, size_t LEDs)
+    {
+        m_bits = bits;
+        m_LEDs = LEDs;
+        m_next = 0;
+        return encodedPatternBits(bits) <= MAX_PATTERN_BITS && bits < 32;
+    }
+    uint64_t run()
+    {
+        unsigned ID = m_next++ % m_LEDs;
+        return encodePattern(ID % (1u << m_bits), m_bits);
+    }
+private:
+    size_t m_bits, m_LEDs, m_next;
+};
+
+class ConstructRotationallyInvariantKernel : public Kernel
+{
+public:
+    const char *name() const { return "constructRotationallyInvariant"; }
+    bool setup(size_t bits, size_t LEDs)
+    {
+        // Use the weight at which the greedy encoding for this many LEDs
+        // stops, capped at the same number of patterns.
+        PatternTable table = greedyOptimalEncode(LEDs, bits, 0);
+        if (table.size() != LEDs) { return false; }
+        m_bits = bits;
+        m_LEDs = LEDs;
+        m_ones = patternWeight(table[LEDs - 1]);
+        return true;
+    }
+    uint64_t run()
+    {
+        return constructRotationallyInvariant(m_ones, m_bits, m_LEDs).size();
+    }
+private:
+    size_t m_bits, m_LEDs, m_ones;
+};
+
+class GreedyOptimalEncodeKernel : public Kernel
+{
+public:
+    const char *name() const { return "greedyOptimalEncode"; }
+    bool setup(size_t bits, size_t LEDs)
+    {
+        m_bits = bits;
+        m_LEDs = LEDs;
+        return greedyOptimalEncode(LEDs, bits, 0).size() == LEDs;
+    }
+    uint64_t run()
+    {
+        return greedyOptimalEncode(m_LEDs, m_bits, 0).size();
+    }
+private:
+    size_t m_bits, m_LEDs;
+};
+
+class ColumnSumsKernel : public Kernel
+{
+public:
+    const char *name() const { return "columnSums"; }
+    bool setup(size_t bits, size_t LEDs) { return benchmarkTable(bits, LEDs, m_table); }
+    uint64_t run() { return columnSums(m_table)[0]; }
+private:
+    PatternTable m_table;
+};
+
+class GreedyOptimumStrideKernel : public Kernel
+{
+public:
+    const char *name() const { return "greedyOptimumStride"; }
+    bool setup(size_t bits, size_t LEDs) { return benchmarkTable(bits, LEDs, m_table); }
+    uint64_t run()
+    {
+        PatternTable table(m_table);
+        greedyOptimumStride(table);
+        return table[table.size() - 1];
+    }
+private:
+    PatternTable m_table;
+};
+
+class GreedyReduceOverlapsKernel : public Kernel
+{
+public:
+    const char *name() const { return "greedyReduceOverlaps"; }
+    bool setup(size_t bits, size_t LEDs)
+    {
+        if (!benchmarkTable(bits, LEDs, m_table)) { return false; }
+        greedyOptimumStride(m_table);
+        return true;
+    }
+    uint64_t run()
+    {
+        // Each pass starts from where the last one left off, as the
+        // repeated passes in the program do.
+        greedyReduceOverlaps(m_table);
+        return m_table[0];
+    }
+private:
+    PatternTable m_table;
+};
+
+class MinimumRotationalDistanceKernel : public Kernel
+{
+public:
+    const char *name() const { return "minimumRotationalDistance"; }
+    bool setup(size_t bits, size_t LEDs) { return benchmarkTable(bits, LEDs, m_table); }
+    uint64_t run() { return minimumRotationalDistance(m_table).pairs; }
+private:
+    PatternTable m_table;
+};
+
+class DecodeKernel : public Kernel
+{
+public:
+    const char *name() const { return "decode"; }
+    bool setup(size_t bits, size_t LEDs)
+    {
+        PatternTable table;
+        if (!benchmarkTable(bits, LEDs, table)) { return false; }
+        greedyOptimumStride(table);
+        if (!m_decoder.build(table)) { return false; }
+
+        // Synthetic observations: every row seen at a random phase, with
+        // one field in sixteen observations misread so that some windows
+        // miss.  There are more than fit in cache, as there would be
+        // over a run of frames.
+        SplitMix64 rng(bits * 1000003 + LEDs);
+        m_observations.resize(OBSERVATIONS);
+        for (size_t i = 0; i < OBSERVATIONS; i++) {
+            Pattern window = rotatePattern(table[rng.below(LEDs)], rng.below(bits), bits);
+            if (rng.below(16) == 0) { window ^= static_cast<Pattern>(1) << rng.below(bits); }
+            m_observations[i] = window;
+        }
+        m_next = 0;
+        return true;
+    }
+    uint64_t run()
+    {
+        DecodedWindow decoded = m_decoder.decode(m_observations[m_next++ & (OBSERVATIONS - 1)]);
+        return static_cast<uint64_t>(decoded.LED + decoded.phase);
+    }
+private:
+    static const size_t OBSERVATIONS = 1 << 20;
+    PatternDecoder m_decoder;
+    std::vector<Pattern> m_observations;
+    size_t m_next;
+};
+
+// Matching a noisy window against every rotation of every row, as each
+// trial of simulateDecoding() does.
+class NearestPatternKernel : public Kernel
+{
+public:
+    NearestPatternKernel() : m_bits(0), m_rng(0) {}
+    const char *name() const { return "nearestPattern"; }
+    bool setup(size_t bits, size_t LEDs)
+    {
+        PatternTable table;
+        if (!benchmarkTable(bits, LEDs, table)) { return false; }
+        m_rotations.clear();
+        for (size_t row = 0; row < LEDs; row++) {
+            for (size_t r = 0; r < bits; r++) {
+                m_rotations.push_back(rotatePattern(table[row], r, bits));
+            }
+        }
+        m_bits = bits;
+        m_rng = SplitMix64(bits * 1000003 + LEDs);
+        return true;
+    }
+    uint64_t run()
+    {
+        Pattern window = m_rotations[m_rng.below(m_rotations.size())]
+            ^ (static_cast<Pattern>(1) << m_rng.below(m_bits));
+        NearestPattern nearest = nearestPattern(m_rotations.data(), m_rotations.size(), window);
+        return nearest.index + nearest.count;
+    }
+private:
+    std::vector<Pattern> m_rotations;
+    size_t m_bits;
+    SplitMix64 m_rng;
+};
+
+// Time a kernel, doubling the number of calls until the run takes at
+// least 'minTime' seconds.  Returns seconds per call and sets 'calls'.
+double timeKernel(Kernel &kernel, double minTime, unsigned long long &calls)
+{
+    typedef std::chrono::steady_clock Clock;
+    benchmarkSink = kernel.run();
+    for (calls = 1; ; calls *= 2) {
+        Clock::time_point start = Clock::now();
+        uint64_t sink = 0;
+        for (unsigned long long i = 0; i < calls; i++) {
+            sink += kernel.run();
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        benchmarkSink = sink;
+        if (elapsed >= minTime) { return elapsed / calls; }
+    }
+}
+
+// Print a time per call with a unit that keeps it short.
+std::string formatTime(double seconds)
+{
+    std::ostringstream out;
+    out.precision(3);
+    if (seconds < 1e-6) { out << seconds * 1e9 << "ns"; }
+    else if (seconds < 1e-3) { out << seconds * 1e6 << "us"; }
+    else if (seconds < 1) { out << seconds * 1e3 << "ms"; }
+    else { out << seconds << "s"; }
+    return out.str();
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<int> bitCounts, LEDCounts;
+    parseRange("8,12,16,20,24,28,32", bitCounts);
+    parseRange("10,20,50,100,200,500,1000,2000", LEDCounts);
+    std::string only;
+    double minTime = 0.02;
+    std::string csvFile;
+    for (int i = 1; i < argc; i++) {
+        if (std::string("-bits") == argv[i]) {
+            if (++i >= argc || !parseRange(argv[i], bitCounts)) { BenchmarkUsage(argv[0]); }
+        }
+        else if (std::string("-LEDs") == argv[i]) {
+            if (++i >= argc || !parseRange(argv[i], LEDCounts)) { BenchmarkUsage(argv[0]); }
+        }
+        else if (std::string("-kernel") == argv[i]) {
+            if (++i >= argc) { BenchmarkUsage(argv[0]); }
+            only = argv[i];
+        }
+        else if (std::string("-rotations") == argv[i]) {
+            if (++i >= argc) { BenchmarkUsage(argv[0]); }
+            bool found = false;
+            for (int k = ROTATION_KERNEL_SCALAR; k <= ROTATION_KERNEL_AVX2 && !found; k++) {
+                RotationKernel kernel = static_cast<RotationKernel>(k);
+                if (std::string(rotationKernelName(kernel)) == argv[i]) {
+                    if (!setRotationKernel(kernel)) {
+                        std::cerr << "This processor cannot run the " << argv[i] << " rotation kernel" << std::endl;
+                        return -1;
+                    }
+                    found = true;
+                }
+            }
+            if (!found) { BenchmarkUsage(argv[0]); }
+        }
+        else if (std::string("-min_time") == argv[i]) {
+            if (++i >= argc) { BenchmarkUsage(argv[0]); }
+            minTime = atof(argv[i]);
+        }
+        else if (std::string("-csv") == argv[i]) {
+            if (++i >= argc) { BenchmarkUsage(argv[0]); }
+            csvFile = argv[i];
+        }
+        else {
+            BenchmarkUsage(argv[0]);
+        }
+    }
+    for (size_t b = 0; b < bitCounts.size(); b++) {
+        if (bitCounts[b] <= 0 || bitCounts[b] > static_cast<int>(MAX_PATTERN_BITS)) {
+            BenchmarkUsage(argv[0]);
+        }
+    }
+    for (size_t l = 0; l < LEDCounts.size(); l++) {
+        if (LEDCounts[l] <= 0) { BenchmarkUsage(argv[0]); }
+    }
+
+    std::ofstream csv;
+    if (!csvFile.empty()) {
+        csv.open(csvFile.c_str());
+        if (!csv) {
+            std::cerr << "Could not open " << csvFile << " for writing" << std::endl;
+            return -2;
+        }
+        csv << "kernel,bits,LEDs,calls,seconds_per_call" << std::endl;
+    }
+
+    std::cout << "Placing rows with the " << rotationKernelName(rotationKernel())
+        << " rotation kernel" << std::endl << std::endl;
+
+    EncodePatternKernel encode;
+    ConstructRotationallyInvariantKernel construct;
+    GreedyOptimalEncodeKernel greedyEncode;
+    ColumnSumsKernel sums;
+    GreedyOptimumStrideKernel optimumStride;
+    GreedyReduceOverlapsKernel reduceOverlaps;
+    MinimumRotationalDistanceKernel distance;
+    DecodeKernel decode;
+    NearestPatternKernel nearest;
+    Kernel *kernels[] = { &encode, &construct, &greedyEncode, &sums
+        , &optimumStride, &reduceOverlaps, &distance, &decode, &nearest };
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        Kernel &kernel = *kernels[k];
+        if (!only.empty() && only != kernel.name()) { continue; }
+
+        // One row per bit count and one column per LED count, so each
+        // row shows how the kernel scales with the number of LEDs.
+        std::cout << kernel.name() << " (time per call; rows are bits, columns are LEDs)" << std::endl;
+        std::cout << "bits";
+        for (size_t l = 0; l < LEDCounts.size(); l++) {
+            std::cout.width(11);
+            std::cout << LEDCounts[l];
+        }
+        std::cout << std::endl;
+        for (size_t b = 0; b < bitCounts.size(); b++) {
+            std::cout.width(4);
+            std::cout << bitCounts[b];
+            for (size_t l = 0; l < LEDCounts.size(); l++) {
+                std::cout.width(11);
+                if (!kernel.setup(bitCounts[b], LEDCounts[l])) {
+                    std::cout << "-";
+                    continue;
+                }
+                unsigned long long calls;
+                double seconds = timeKernel(kernel, minTime, calls);
+                std::cout << formatTime(seconds);
+                std::cout.flush();
+                if (csv.is_open()) {
+                    csv << kernel.name() << "," << bitCounts[b] << "," << LEDCounts[l]
+                        << "," << calls << "," << seconds << std::endl;
+                }
+            }
+            std::cout << std::endl;
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+// Check that the compile-time table in LED_firmware.h has the same bytes
+// as the runtime pipeline, for a few configurations.  Run by CTest.
+
+#include "LED_firmware.h"
+#include "LED_output.h"
+#include "LED_solver.h"
+
+#include <iostream>
+#include <vector>
+
+// Compare one compile-time table with what solve() and the firmware
+// output give for the same parameters.
+template <class Table>
+bool matchesRuntime(unsigned LEDs, unsigned bits, unsigned parity, int stride
+    , const std::vector<int> &skip)
+{
+    SolveParameters params;
+    params.LEDs = LEDs;
+    params.bits = bits;
+    params.parity = parity;
+    params.stride = stride;
+    params.stride_optimizations = 0;
+    SolveResult result;
+    if (solve(params, result) != SOLVE_OK) { return false; }
+
+    std::vector<int> outputs = firmwareOutputs(result.table.size(), skip);
+    std::vector<unsigned char> bytes(firmwareColumnBytes(outputs.size()));
+    bool same = (outputs.size() == Table::outputs)
+        && (bytes.size() == Table::ImageType::columnBytes)
+        && (result.peak == Table::image.maxBrightness);
+    for (size_t col = 0; col < bits && same; col++) {
+        firmwareColumn(result.table, outputs, col, &bytes[0]);
+        for (size_t i = 0; i < bytes.size(); i++) {
+            same = same && (bytes[i] == Table::image.bytes[col][i]);
+        }
+    }
+    std::cout << LEDs << " LEDs, " << bits << " bits: " << (same ? "same" : "DIFFERENT") << std::endl;
+    return same;
+}
+
+int main()
+{
+    bool ok = true;
+    ok = matchesRuntime<LEDFirmware::Table<40, 10, 2, 3, 21, 5, 17> >(40, 10, 2, 3, { 5, 17 }) && ok;
+    ok = matchesRuntime<LEDFirmware::Table<32, 10, 1, 4, 32> >(32, 10, 1, 4, {}) && ok;
+    ok = matchesRuntime<LEDFirmware::Table<20, 8, 0, 1, 20, 0, 7, 30> >(20, 8, 0, 1, { 0, 7, 30 }) && ok;
+    std::cout << (ok ? "Passed" : "Failed") << std::endl;
+    return ok ? 0 : 1;
+}
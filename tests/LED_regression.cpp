@@ -0,0 +1,448 @@
+// Regression tests for the LED_solver library, run by CTest.  Each
+// golden configuration in golden.txt is solved and the table checked for
+// validity, its maximum brightness against the stored baseline and its
+// solve time against the budget, so that a change that makes packings
+// worse or slower fails the build.  The other tests check that the
+// rotation kernels agree, that the pattern counts match enumeration,
+// that the decoding simulator counts what it should and that repeated
+// solves do not allocate.
+
+#include "LED_solver.h"
+#include "LED_simulator.h"
+
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Heap allocations made by the whole program, counted by replacing the
+// global allocation functions (the array forms call these).
+static std::atomic<unsigned long long> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p) { throw std::bad_alloc(); }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void RegressionUsage(std::string name)
+{
+    std::cout << "Usage: " << name << " -golden FILE NAME | -rotation_kernels | -capacity | -simulation | -allocations" << std::endl;
+    std::cout << "       -golden: Solve the configuration NAME from FILE and check the result" << std::endl;
+    std::cout << "       -rotation_kernels: Check that every supported rotation kernel gives the same answers" << std::endl;
+    std::cout << "       -capacity: Check the closed-form pattern counts against enumeration" << std::endl;
+    std::cout << "       -simulation: Check the decoding simulator on clean and noisy windows" << std::endl;
+    std::cout << "       -allocations: Check that repeated solves do not allocate on the heap" << std::endl;
+    exit(-1);
+}
+
+// Counts failed checks, printing each one.
+class Checker
+{
+public:
+    Checker() : m_failures(0) {}
+
+    void check(bool ok, const std::string &what)
+    {
+        if (!ok) {
+            std::cout << "FAILED: " << what << std::endl;
+            m_failures++;
+        }
+    }
+
+    int result() const
+    {
+        std::cout << (m_failures == 0 ? "Passed" : "Failed") << std::endl;
+        return (m_failures == 0) ? 0 : 1;
+    }
+
+private:
+    int m_failures;
+};
+
+// A golden configuration read from the file.
+struct GoldenConfig
+{
+    GoldenConfig() : infeasible(false), timedOut(false), peak(-1), lowerBound(-1), seconds(-1) {}
+
+    std::string name;
+    SolveParameters params;
+    bool infeasible;
+    bool timedOut;
+    int peak;
+    int lowerBound;
+    double seconds;
+};
+
+// Read the configuration named 'name'; returns false if it is not in
+// the file or does not parse.
+bool readGoldenConfig(const std::string &file, const std::string &name, GoldenConfig &config)
+{
+    std::ifstream in(file.c_str());
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream words(line);
+        std::string word;
+        if (!(words >> word) || word[0] == '#' || word != name) { continue; }
+        config.name = word;
+        while (words >> word) {
+            size_t equals = word.find('=');
+            std::string key = word.substr(0, equals);
+            std::string value = (equals == std::string::npos) ? "" : word.substr(equals + 1);
+            if (key == "LEDs") { config.params.LEDs = atoi(value.c_str()); }
+            else if (key == "bits") { config.params.bits = atoi(value.c_str()); }
+            else if (key == "parity") { config.params.parity = atoi(value.c_str()); }
+            else if (key == "stride") { config.params.stride = atoi(value.c_str()); }
+            else if (key == "stride_optimize") { config.params.stride_optimizations = atoi(value.c_str()); }
+            else if (key == "simple_encoding") { config.params.simple_encoding = true; }
+            else if (key == "maximize_distance") { config.params.maximize_distance = true; }
+            else if (key == "anneal") { config.params.anneal_starts = atoi(value.c_str()); }
+            else if (key == "anneal_steps") { config.params.anneal_steps = strtoull(value.c_str(), NULL, 10); }
+            else if (key == "exact") { config.params.exact = true; }
+            else if (key == "time_budget") { config.params.time_budget = atof(value.c_str()); }
+            else if (key == "infeasible") { config.infeasible = true; }
+            else if (key == "timed_out") { config.timedOut = true; }
+            else if (key == "peak") { config.peak = atoi(value.c_str()); }
+            else if (key == "lower_bound") { config.lowerBound = atoi(value.c_str()); }
+            else if (key == "seconds") { config.seconds = atof(value.c_str()); }
+            else { return false; }
+        }
+        return config.seconds > 0 && (config.infeasible || config.peak >= 0);
+    }
+    return false;
+}
+
+// Check that the result is a valid table for the parameters.
+void checkTable(const SolveParameters &params, const SolveResult &result, Checker &checker)
+{
+    const PatternTable &unshifted = result.unshifted;
+    const PatternTable &table = result.table;
+    size_t bits = params.simple_encoding ? encodedPatternBits(params.bits) : params.bits;
+    checker.check(unshifted.size() == params.LEDs && table.size() == params.LEDs
+        , "one row per LED");
+    checker.check(unshifted.bits() == bits && table.bits() == bits, "rows have the right length");
+    if (table.size() != unshifted.size() || table.bits() != bits) { return; }
+
+    // The shifted rows are rotations of the unshifted ones (shifting
+    // also reorders them), and no two patterns are rotations of one
+    // another.
+    std::vector<Pattern> canonical(table.size()), canonicalUnshifted(table.size());
+    for (size_t i = 0; i < table.size(); i++) {
+        canonical[i] = canonicalRotation(table[i], bits);
+        canonicalUnshifted[i] = canonicalRotation(unshifted[i], bits);
+    }
+    std::sort(canonical.begin(), canonical.end());
+    std::sort(canonicalUnshifted.begin(), canonicalUnshifted.end());
+    checker.check(canonical == canonicalUnshifted, "the shifted rows are rotations of the unshifted rows");
+    checker.check(std::adjacent_find(canonical.begin(), canonical.end()) == canonical.end()
+        , "patterns are unique under rotation");
+
+    // The encoding itself.
+    bool encoded = true;
+    for (size_t i = 0; i < unshifted.size(); i++) {
+        Pattern p = unshifted[i];
+        if (params.simple_encoding) {
+            if (p != encodePattern(static_cast<unsigned>(i), params.bits)) { encoded = false; }
+        }
+        else if (p == 0 || (params.parity == 1 && patternWeight(p) % 2 != 1)
+            || (params.parity == 2 && patternWeight(p) % 2 != 0)) {
+            encoded = false;
+        }
+    }
+    checker.check(encoded, params.simple_encoding ? "rows are the simple encodings of their IDs"
+        : "no empty patterns and parity respected");
+
+    // The histogram, peak and bound agree with the table, and the table
+    // has as few 1's as the encoding allows.
+    std::vector<int> sums = columnSums(table);
+    checker.check(sums == result.histogram, "histogram matches the table");
+    checker.check(!sums.empty() && result.peak == *std::max_element(sums.begin(), sums.end())
+        , "peak is the largest column sum");
+    checker.check(result.bound == theoreticalMinimum(sums, bits), "bound matches the histogram");
+    checker.check(result.bound <= result.peak, "the theoretical minimum holds");
+    checker.check(result.lowerBound == peakLowerBound(table) && result.lowerBound <= result.peak
+        , "the lower bound holds");
+    uint64_t ones = 0;
+    for (size_t i = 0; i < sums.size(); i++) { ones += sums[i]; }
+    checker.check(ones == encodingWeight(params.LEDs, params.bits, params.parity, params.simple_encoding)
+        , "total weight is the least the encoding allows");
+
+    // The trajectory starts with the first shift and only goes down,
+    // ending at the result.
+    const std::vector<TrajectoryPoint> &trajectory = result.trajectory;
+    bool falling = !trajectory.empty() && trajectory.back().peak == result.peak;
+    for (size_t i = 1; i < trajectory.size(); i++) {
+        falling = falling && trajectory[i].peak < trajectory[i - 1].peak
+            && trajectory[i].seconds >= trajectory[i - 1].seconds;
+    }
+    checker.check(falling, "the trajectory falls to the maximum brightness");
+}
+
+int testGolden(const std::string &file, const std::string &name)
+{
+    GoldenConfig config;
+    if (!readGoldenConfig(file, name, config)) {
+        std::cout << "No valid configuration " << name << " in " << file << std::endl;
+        return 1;
+    }
+
+    Checker checker;
+    SolveResult result;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SolveStatus status = solve(config.params, result);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << seconds << " seconds (budget " << config.seconds << ")";
+
+    if (config.infeasible) {
+        std::cout << std::endl;
+        checker.check(status == SOLVE_NOT_ENOUGH_BITS, "the LEDs do not fit");
+    }
+    else {
+        std::cout << ", maximum brightness " << result.peak << " (baseline " << config.peak << ")"
+            << std::endl;
+        checker.check(status == SOLVE_OK, "the solve succeeds");
+        if (status == SOLVE_OK) {
+            checkTable(config.params, result, checker);
+            checker.check(result.peak <= config.peak, "maximum brightness is no worse than the baseline");
+            if (result.peak < config.peak && !config.timedOut) {
+                std::cout << "Maximum brightness improved; lower the baseline in " << file << std::endl;
+            }
+            if (config.params.exact && !result.timedOut) {
+                checker.check(result.exact.optimal, "the exact search proves its result");
+            }
+            if (config.timedOut) {
+                checker.check(result.timedOut, "the time budget runs out");
+            }
+            if (config.lowerBound >= 0) {
+                checker.check(result.lowerBound == config.lowerBound && result.lowerBound > result.bound
+                    , "the lower bound is above the theoretical minimum");
+            }
+        }
+    }
+    checker.check(seconds <= config.seconds, "solve time is within the budget");
+    return checker.result();
+}
+
+int testRotationKernels()
+{
+    // Random histograms and patterns of every length, compared against
+    // the scalar kernel.
+    Checker checker;
+    SplitMix64 rng(1);
+    RotationKernel original = rotationKernel();
+    for (int k = ROTATION_KERNEL_SCALAR; k <= ROTATION_KERNEL_AVX2; k++) {
+        RotationKernel kernel = static_cast<RotationKernel>(k);
+        if (!rotationKernelSupported(kernel)) {
+            std::cout << rotationKernelName(kernel) << ": not supported here" << std::endl;
+            continue;
+        }
+        std::cout << rotationKernelName(kernel) << std::endl;
+        bool same = true;
+        for (int trial = 0; trial < 5000 && same; trial++) {
+            size_t bits = 1 + rng.below(MAX_PATTERN_BITS);
+            int counts[MAX_PATTERN_BITS];
+            for (size_t col = 0; col < bits; col++) { counts[col] = static_cast<int>(rng.below(100)); }
+            Pattern p = rng.next() & patternMask(bits);
+
+            // Some repeated patterns, so that there are ties.
+            std::vector<Pattern> patterns(rng.below(600));
+            for (size_t i = 0; i < patterns.size(); i++) {
+                patterns[i] = (i > 0 && rng.below(4) == 0) ? patterns[rng.below(i)]
+                    : rng.next() & patternMask(bits);
+            }
+
+            int maxCounts[2][MAX_PATTERN_BITS], minCounts[2][MAX_PATTERN_BITS];
+            size_t lowest[2], best[2];
+            NearestPattern nearest[2];
+            RotationKernel pair[2] = { ROTATION_KERNEL_SCALAR, kernel };
+            for (int i = 0; i < 2; i++) {
+                setRotationKernel(pair[i]);
+                rotationExtremes(counts, bits, p, maxCounts[i], minCounts[i]);
+                lowest[i] = lowestPeakRotation(counts, bits, p);
+                best[i] = bestRotation(counts, bits, p);
+                nearest[i] = nearestPattern(patterns.data(), patterns.size(), p);
+            }
+            same = std::equal(maxCounts[0], maxCounts[0] + bits, maxCounts[1])
+                && std::equal(minCounts[0], minCounts[0] + bits, minCounts[1])
+                && lowest[0] == lowest[1] && best[0] == best[1]
+                && nearest[0].distance == nearest[1].distance && nearest[0].count == nearest[1].count
+                && nearest[0].index == nearest[1].index;
+
+            // The scalar nearest pattern against comparing each one.
+            int closest = static_cast<int>(MAX_PATTERN_BITS) + 1;
+            size_t atClosest = 0, first = 0;
+            for (size_t i = 0; i < patterns.size(); i++) {
+                int d = static_cast<int>(patternWeight(patterns[i] ^ p));
+                if (d < closest) {
+                    closest = d;
+                    atClosest = 0;
+                    first = i;
+                }
+                if (d == closest) { atClosest++; }
+            }
+            same = same && nearest[0].distance == closest && nearest[0].count == atClosest
+                && nearest[0].index == first;
+
+            // The scalar kernel against adding each rotation directly.
+            for (size_t r = 0; r < bits && same; r++) {
+                std::vector<int> rotated(counts, counts + bits);
+                for (size_t col = 0; col < bits; col++) {
+                    rotated[col] += patternField(rotatePattern(p, r, bits), col, bits);
+                }
+                same = maxCounts[0][r] == *std::max_element(rotated.begin(), rotated.end())
+                    && minCounts[0][r] == *std::min_element(rotated.begin(), rotated.end());
+            }
+        }
+        checker.check(same, std::string(rotationKernelName(kernel)) + " matches the scalar kernel");
+    }
+    setRotationKernel(original);
+    return checker.result();
+}
+
+int testCapacity()
+{
+    Checker checker;
+    for (size_t bits = 1; bits <= 20; bits++) {
+        bool counts = true;
+        for (size_t ones = 0; ones <= bits; ones++) {
+            counts = counts && necklaceCount(ones, bits) == constructRotationallyInvariant(ones, bits).size();
+        }
+        std::ostringstream name;
+        name << bits << " bits";
+        checker.check(counts, "necklace counts for " + name.str());
+        for (unsigned parity = 0; parity <= 2; parity++) {
+            uint64_t capacity = encodingCapacity(bits, parity);
+            PatternTable all = greedyEncodeUpTo(static_cast<size_t>(capacity) + 1, bits, parity);
+            checker.check(all.size() == capacity, "greedy capacity for " + name.str());
+            checker.check(minimumEncodingBits(static_cast<size_t>(capacity), parity) <= bits
+                , "minimum bits for " + name.str());
+        }
+    }
+    for (size_t bits = 1; bits <= 10; bits++) {
+        uint64_t capacity = encodingCapacity(bits, 0, true);
+        checker.check(simpleEncodeUpTo(static_cast<size_t>(capacity) + 1, bits).size() == capacity
+            , "simple encoding capacity");
+    }
+    return checker.result();
+}
+
+int testSimulation()
+{
+    Checker checker;
+    SolveParameters params;
+    SolveResult result;
+    checker.check(solve(params, result) == SOLVE_OK, "the default configuration solves");
+    const PatternTable &table = result.table;
+    const unsigned long long TRIALS = 2000;
+
+    // Without noise every window decodes correctly.
+    NoiseModel clean;
+    SimulationResult exact = simulateDecoding(table, clean, TRIALS, 0, 1);
+    checker.check(exact.trials == TRIALS * table.size() && exact.noisy == 0
+        && exact.correct == exact.trials && exact.confusions.empty(), "clean windows all decode");
+
+    // With noise, the outcomes account for every window and the
+    // confusions for every error, and nothing depends on the threads.
+    NoiseModel noise;
+    noise.flip = 0.02;
+    noise.drop = 0.01;
+    noise.slip = 0.01;
+    SimulationResult one = simulateDecoding(table, noise, TRIALS, -1, 1, 1);
+    SimulationResult three = simulateDecoding(table, noise, TRIALS, -1, 1, 3);
+    checker.check(one.correct + one.misidentified + one.ambiguous + one.rejected == one.trials
+        , "every window has one outcome");
+    checker.check(one.noisy > 0 && one.misidentified > 0 && one.ambiguous > 0 && one.rejected == 0
+        , "noise causes errors but nothing is rejected");
+    unsigned long long errors = 0;
+    bool sorted = true;
+    for (size_t i = 0; i < one.confusions.size(); i++) {
+        const Confusion &c = one.confusions[i];
+        errors += c.count;
+        sorted = sorted && c.LED != c.decodedAs && (i == 0 || c.count <= one.confusions[i - 1].count);
+    }
+    checker.check(errors == one.trials - one.correct && sorted, "confusions account for the errors");
+    bool same = one.noisy == three.noisy && one.correct == three.correct
+        && one.confusions.size() == three.confusions.size();
+    for (size_t i = 0; same && i < one.confusions.size(); i++) {
+        same = one.confusions[i].LED == three.confusions[i].LED
+            && one.confusions[i].decodedAs == three.confusions[i].decodedAs
+            && one.confusions[i].count == three.confusions[i].count;
+    }
+    checker.check(same, "results do not depend on the number of threads");
+
+    // Only exact rotations are accepted at distance 0, so every noisy
+    // window that is not the rotation of another row is rejected.
+    SimulationResult strict = simulateDecoding(table, noise, TRIALS, 0, 1, 1);
+    checker.check(strict.noisy == one.noisy && strict.ambiguous == 0
+        && strict.correct + strict.misidentified + strict.rejected == strict.trials
+        && strict.rejected > 0, "distance 0 rejects what it cannot match exactly");
+    return checker.result();
+}
+
+int testAllocations()
+{
+    // Configurations that shift with and without the overlap passes,
+    // stop them early, and use the simple encoding.
+    std::vector<SolveParameters> configs(6);
+    configs[1].parity = 1;
+    configs[1].stride = 3;
+    configs[1].stride_optimizations = 0;
+    configs[2].LEDs = 12;
+    configs[2].bits = 8;
+    configs[3].LEDs = 500;
+    configs[3].bits = 32;
+    configs[3].parity = 0;
+    configs[4].simple_encoding = true;
+    configs[4].bits = 6;
+    configs[5].time_budget = 10;
+
+    Checker checker;
+    for (size_t c = 0; c < configs.size(); c++) {
+        configs[c].threads = 1;
+        SolveResult result;
+        SolveScratch scratch;
+        solve(configs[c], result, scratch);
+        solve(configs[c], result, scratch);
+        unsigned long long before = allocations;
+        SolveStatus status = solve(configs[c], result, scratch);
+        unsigned long long count = allocations - before;
+        std::cout << configs[c].LEDs << " LEDs, " << configs[c].bits << " bits: "
+            << count << " allocations" << std::endl;
+        checker.check(status == SOLVE_OK && count == 0, "a repeated solve does not allocate");
+    }
+    return checker.result();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 4 && std::string("-golden") == argv[1]) {
+        return testGolden(argv[2], argv[3]);
+    }
+    if (argc == 2 && std::string("-rotation_kernels") == argv[1]) {
+        return testRotationKernels();
+    }
+    if (argc == 2 && std::string("-capacity") == argv[1]) {
+        return testCapacity();
+    }
+    if (argc == 2 && std::string("-simulation") == argv[1]) {
+        return testSimulation();
+    }
+    if (argc == 2 && std::string("-allocations") == argv[1]) {
+        return testAllocations();
+    }
+    RegressionUsage(argv[0]);
+    return -1;
+}